@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+
+#include "affinity.h"
+
+#include <errno.h>
+#include <linux/filter.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief Read the CPU list of a NUMA node from sysfs.
+ */
+static int node_cpulist(int node, char *buf, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    int ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief NUMA node of a CPU, or -1 if the kernel has no NUMA support.
+ */
+static int cpu_node(int cpu) {
+    for (int node = 0; node < 64; node++) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0) {
+            return node;
+        }
+    }
+    return -1;
+}
+
+int cpulist_parse(const char *spec, int *cpus, int max) {
+    char *copy = strdup(spec);
+    char *save = NULL;
+    int n = 0;
+
+    for (char *item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        if (strncmp(item, "node", 4) == 0) {
+            char list[256];
+            char *end;
+            long node = strtol(item + 4, &end, 10);
+            if (end == item + 4 || *end != '\0' || node_cpulist(node, list, sizeof(list)) == -1) {
+                n = -1;
+                break;
+            }
+            int added = cpulist_parse(list, cpus + n, max - n);
+            if (added < 0) {
+                n = -1;
+                break;
+            }
+            n += added;
+            continue;
+        }
+
+        char *end;
+        long first = strtol(item, &end, 10);
+        long last = first;
+        if (end != item && *end == '-') {
+            char *range = end + 1;
+            last = strtol(range, &end, 10);
+            if (end == range) {
+                end = item;
+            }
+        }
+        if (end == item || *end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) {
+            n = -1;
+            break;
+        }
+        for (long cpu = first; cpu <= last && n < max; cpu++) {
+            cpus[n++] = cpu;
+        }
+    }
+    free(copy);
+    return n;
+}
+
+int pin_to_cpus(const int *cpus, int n) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < n; i++) {
+        CPU_SET(cpus[i], &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        return -1;
+    }
+
+    int node = cpu_node(cpus[0]);
+    if (node >= 0) {
+        unsigned long nodemask = 1UL << node;
+        // Best effort: a kernel without NUMA support refuses with ENOSYS
+        syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8);
+    }
+    return 0;
+}
+
+int reuseport_steer(int fd, const int *cpus, int n) {
+    struct sock_filter *code = calloc(2 * n + 3, sizeof(*code));
+    int len = 0;
+    if (code == NULL) {
+        return -1;
+    }
+
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (int i = 0; i < n; i++) {
+        code[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpus[i], 0, 1);
+        code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, i);
+    }
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, n);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+
+    struct sock_fprog prog = {.len = len, .filter = code};
+    int ret = setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+    int saved = errno;
+    free(code);
+    errno = saved;
+    return ret;
+}
@@ -0,0 +1,44 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#define AFFINITY_MAX_CPUS 1024
+
+/**
+ * @brief Parse a CPU list such as "0-3,6" or "node1", or a mix of both.
+ *
+ * "node<N>" stands for every CPU of NUMA node N, as listed in sysfs.
+ *
+ * @param spec CPU list.
+ * @param cpus Filled with the CPUs in the order given.
+ * @param max Capacity of cpus.
+ * @return int Number of CPUs, or -1 if the list is malformed or names an unknown node.
+ */
+int cpulist_parse(const char *spec, int *cpus, int max);
+
+/**
+ * @brief Pin the calling process to CPUs and prefer their NUMA node's memory.
+ *
+ * Memory touched afterwards (relay buffers, session state) is then
+ * allocated on the node the CPUs belong to.
+ *
+ * @param cpus CPUs to run on.
+ * @param n Number of CPUs.
+ * @return int 0 on success, -1 with errno set.
+ */
+int pin_to_cpus(const int *cpus, int n);
+
+/**
+ * @brief Steer connections of a SO_REUSEPORT group by the CPU that received them.
+ *
+ * Attaches a classic BPF program to the group: a connection handled by
+ * cpus[i] goes to the i-th socket of the group, any other to the socket
+ * its CPU number selects modulo n.
+ *
+ * @param fd Any listening socket of the group.
+ * @param cpus CPU served by each socket, in the order they joined the group.
+ * @param n Number of sockets.
+ * @return int 0 on success, -1 with errno set.
+ */
+int reuseport_steer(int fd, const int *cpus, int n);
+
+#endif
@@ -0,0 +1,306 @@
+#include "balance.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * @brief FNV-1a hash of a string, placing ring points.
+ */
+static uint32_t hash_string(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h = (h ^ (uint8_t)*s++) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief Murmur3 finalizer, spreading client addresses over the ring.
+ */
+static uint32_t hash_addr(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static void backend_connected(void *arg, int err);
+
+static int point_cmp(const void *a, const void *b) {
+    uint32_t x = ((const struct balance_point *)a)->hash;
+    uint32_t y = ((const struct balance_point *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+int balancer_init(struct balancer *b, const char *list, const char *policy) {
+    memset(b, 0, sizeof(*b));
+    if (policy == NULL || strcmp(policy, "rr") == 0) {
+        b->policy = BALANCE_RR;
+    } else if (strcmp(policy, "least") == 0) {
+        b->policy = BALANCE_LEAST;
+    } else if (strcmp(policy, "hash") == 0) {
+        b->policy = BALANCE_HASH;
+    } else {
+        fprintf(stderr, "Invalid balancing policy %s, expected rr, least or hash\n", policy);
+        return -1;
+    }
+
+    char *copy = strdup(list);
+    char *save = NULL;
+    for (char *item = strtok_r(copy, " ", &save); item != NULL; item = strtok_r(NULL, " ", &save)) {
+        if (b->nbackends == BALANCE_MAX_BACKENDS) {
+            fprintf(stderr, "More than %d backends given\n", BALANCE_MAX_BACKENDS);
+            free(copy);
+            return -1;
+        }
+        b->backends = realloc(b->backends, (b->nbackends + 1) * sizeof(*b->backends));
+        struct backend *be = &b->backends[b->nbackends++];
+        memset(be, 0, sizeof(*be));
+        be->up = 1;  // Until a connect or a probe says otherwise
+        be->check_fd = -1;
+
+        size_t len = strlen(item);
+        size_t suffix = strlen(BALANCE_REUSE_SUFFIX);
+        if (len > suffix && strcmp(item + len - suffix, BALANCE_REUSE_SUFFIX) == 0) {
+            item[len - suffix] = '\0';
+            be->reuse = 1;
+        }
+
+        if (strncmp(item, "UDSCS", 5) == 0) {
+            struct sockaddr_un *un = (struct sockaddr_un *)&be->addr;
+            if (strlen(item + 5) >= sizeof(un->sun_path)) {
+                fprintf(stderr, "Backend path %s is too long\n", item + 5);
+                free(copy);
+                return -1;
+            }
+            un->sun_family = AF_UNIX;
+            strcpy(un->sun_path, item + 5);
+            be->addrlen = sizeof(*un);
+            strcpy(be->name, un->sun_path);
+            continue;
+        }
+
+        char *port = strchr(item, ',');
+        struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+        struct addrinfo *res;
+        if (port == NULL) {
+            fprintf(stderr, "Invalid backend %s, expected ip,port or UDSCS<path>\n", item);
+            free(copy);
+            return -1;
+        }
+        *port++ = '\0';
+        if (getaddrinfo(item, port, &hints, &res) != 0) {
+            fprintf(stderr, "Invalid backend address %s\n", item);
+            free(copy);
+            return -1;
+        }
+        memcpy(&be->addr, res->ai_addr, res->ai_addrlen);
+        be->addrlen = res->ai_addrlen;
+        freeaddrinfo(res);
+        snprintf(be->name, sizeof(be->name), "%s:%s", inet_ntoa(((struct sockaddr_in *)&be->addr)->sin_addr), port);
+    }
+    free(copy);
+    if (b->nbackends == 0) {
+        fprintf(stderr, "No backends given\n");
+        return -1;
+    }
+
+    for (int i = 0; i < b->nbackends; i++) {
+        struct backend *be = &b->backends[i];
+        be->balancer = b;
+        ev_timer_init(&be->check_timer);  // Once the array no longer moves
+        pool_init(&be->pool, (struct sockaddr *)&be->addr, be->addrlen, backend_connected, be);
+    }
+    if (b->policy == BALANCE_HASH) {
+        b->nring = b->nbackends * BALANCE_VNODES;
+        b->ring = calloc(b->nring, sizeof(*b->ring));
+        for (int i = 0; i < b->nbackends; i++) {
+            for (int v = 0; v < BALANCE_VNODES; v++) {
+                char key[sizeof(b->backends[i].name) + 16];
+                snprintf(key, sizeof(key), "%s#%d", b->backends[i].name, v);
+                b->ring[i * BALANCE_VNODES + v] = (struct balance_point){hash_string(key), i};
+            }
+        }
+        qsort(b->ring, b->nring, sizeof(*b->ring), point_cmp);
+    }
+    return 0;
+}
+
+static void backend_up(struct backend *be) {
+    if (!be->up) {
+        fprintf(stderr, "Backend %s is up\n", be->name);
+        be->up = 1;
+    }
+}
+
+void backend_failed(struct backend *be, int err) {
+    be->failures++;
+    if (be->up) {
+        fprintf(stderr, "Backend %s is down: %s\n", be->name, strerror(err));
+        be->up = 0;
+    }
+}
+
+/**
+ * @brief Connect result of a pooled connection, which doubles as a probe.
+ */
+static void backend_connected(void *arg, int err) {
+    if (err != 0) {
+        backend_failed(arg, err);
+    } else {
+        backend_up(arg);
+    }
+}
+
+/**
+ * @brief Finish a health probe.
+ */
+static void probe_done(struct backend *be, int err) {
+    ev_io_del(be->balancer->loop, &be->check_io);
+    close(be->check_fd);
+    be->check_fd = -1;
+    if (err != 0) {
+        backend_failed(be, err);
+    } else {
+        backend_up(be);
+    }
+}
+
+/**
+ * @brief A probe connection completed or failed.
+ */
+static void on_check_io(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct backend *be = io->arg;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(be->check_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    probe_done(be, err);
+}
+
+/**
+ * @brief Start the next probe; one still in flight counts as failed.
+ */
+static void on_check_timer(struct evloop *loop, struct ev_timer *timer) {
+    struct backend *be = timer->arg;
+    ev_timer_start(loop, &be->check_timer, be->balancer->check_interval, on_check_timer, be);
+
+    if (be->check_fd != -1) {
+        probe_done(be, ETIMEDOUT);
+    }
+    if (be->up) {
+        pool_fill(&be->pool, loop);  // Top up connections the backend closed while idle
+    }
+    int fd = socket(be->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return;
+    }
+    if (connect(fd, (struct sockaddr *)&be->addr, be->addrlen) == 0 || errno == EAGAIN) {
+        close(fd);
+        backend_up(be);  // A Unix listener with a full backlog is busy, not down
+        return;
+    }
+    if (errno != EINPROGRESS) {
+        backend_failed(be, errno);
+        close(fd);
+        return;
+    }
+    be->check_fd = fd;
+    if (ev_io_add(loop, &be->check_io, fd, EPOLLOUT, on_check_io, be) == -1) {
+        close(fd);
+        be->check_fd = -1;
+    }
+}
+
+void balancer_pool(struct balancer *b, int min_idle, int max_idle) {
+    for (int i = 0; i < b->nbackends; i++) {
+        b->backends[i].pool.min_idle = min_idle;
+        b->backends[i].pool.max_idle = max_idle;
+    }
+}
+
+void balancer_start(struct balancer *b, struct evloop *loop, unsigned long interval) {
+    b->loop = loop;
+    b->check_interval = interval;
+    for (int i = 0; i < b->nbackends; i++) {
+        pool_fill(&b->backends[i].pool, loop);
+    }
+    if (interval == 0) {
+        return;
+    }
+    for (int i = 0; i < b->nbackends; i++) {
+        // Spread the probes over the interval
+        ev_timer_start(loop, &b->backends[i].check_timer, 1 + interval * i / b->nbackends, on_check_timer,
+                       &b->backends[i]);
+    }
+}
+
+struct backend *balancer_pick(struct balancer *b, in_addr_t client, uint64_t tried) {
+    int n = b->nbackends;
+    int healthy = 0;
+    for (int i = 0; i < n; i++) {
+        healthy += b->backends[i].up && !(tried >> i & 1);
+    }
+#define CANDIDATE(be) (((be)->up || healthy == 0) && !(tried >> ((be) - b->backends) & 1))
+
+    if (b->policy == BALANCE_HASH) {
+        uint32_t h = hash_addr(ntohl(client));
+        int lo = 0, hi = b->nring;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (b->ring[mid].hash < h) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        for (int i = 0; i < b->nring; i++) {
+            struct backend *be = &b->backends[b->ring[(lo + i) % b->nring].backend];
+            if (CANDIDATE(be)) {
+                return be;
+            }
+        }
+        return NULL;
+    }
+
+    struct backend *best = NULL;
+    for (int i = 0; i < n; i++) {
+        struct backend *be = &b->backends[(b->cursor + i) % n];
+        if (!CANDIDATE(be)) {
+            continue;
+        }
+        if (b->policy == BALANCE_RR) {
+            b->cursor = (be - b->backends) + 1;
+            return be;
+        }
+        if (best == NULL || be->active < best->active) {
+            best = be;
+        }
+    }
+    b->cursor++;  // Ties among least loaded rotate
+    return best;
+#undef CANDIDATE
+}
+
+void balancer_close(struct balancer *b) {
+    for (int i = 0; i < b->nbackends; i++) {
+        struct backend *be = &b->backends[i];
+        if (b->loop != NULL) {
+            ev_timer_stop(b->loop, &be->check_timer);
+        }
+        if (be->check_fd != -1) {
+            ev_io_del(b->loop, &be->check_io);
+            close(be->check_fd);
+        }
+        pool_close(&be->pool);
+    }
+    free(b->backends);
+    free(b->ring);
+}
@@ -0,0 +1,124 @@
+#ifndef BALANCE_H
+#define BALANCE_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "evloop.h"
+#include "pool.h"
+
+#define BALANCE_RR 0     // Round-robin over healthy backends
+#define BALANCE_LEAST 1  // Fewest active sessions
+#define BALANCE_HASH 2   // Consistent hash of the client IP
+
+#define BALANCE_VNODES 64             // Points per backend on the consistent-hash ring
+#define BALANCE_CHECK_MS 1000         // Default interval of active health checks
+#define BALANCE_REUSE_SUFFIX "+reuse"  // Backend opt-in to reusing connections across clients
+#define BALANCE_MAX_BACKENDS 64       // One bit each in the set of backends a client tried
+
+struct balancer;
+
+/**
+ * @brief A backend server and its health.
+ */
+struct backend {
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    char name[sizeof(((struct sockaddr_un *)0)->sun_path) + 8];  // "ip:port" or the socket path, for logs
+    int up;
+    int active;             // Sessions currently relayed to it
+    unsigned long sessions;
+    unsigned long failures;
+    int check_fd;           // Probe connection in flight, or -1
+    struct ev_io check_io;
+    struct ev_timer check_timer;
+    struct conn_pool pool;  // Warm connections leased by sessions
+    int reuse;              // A connection a client left cleanly may serve the next one (stateless protocols)
+    struct balancer *balancer;
+};
+
+/**
+ * @brief Point of the consistent-hash ring.
+ */
+struct balance_point {
+    uint32_t hash;
+    int backend;
+};
+
+/**
+ * @brief A set of backends and the policy choosing among them.
+ */
+struct balancer {
+    struct backend *backends;
+    int nbackends;
+    int policy;
+    unsigned cursor;                 // Round-robin position
+    struct balance_point *ring;      // Sorted by hash, for BALANCE_HASH
+    int nring;
+    unsigned long check_interval;    // Milliseconds between probes, 0 to disable
+    struct evloop *loop;
+};
+
+/**
+ * @brief Parse a backend list and a policy name.
+ *
+ * @param b Balancer to initialize.
+ * @param list Backends as "ip,port" or "UDSCS<path>", separated by spaces, each
+ *             optionally followed by BALANCE_REUSE_SUFFIX.
+ * @param policy "rr", "least" or "hash".
+ * @return int 0 on success, -1 after printing the reason.
+ */
+int balancer_init(struct balancer *b, const char *list, const char *policy);
+
+/**
+ * @brief Keep warm connections to every backend.
+ *
+ * Must be called before balancer_start(). The pools are filled when the
+ * checks start, after every lease and on every health check.
+ *
+ * @param b Balancer.
+ * @param min_idle Connections kept ready per backend.
+ * @param max_idle Idle connections kept at most per backend, including returned ones.
+ */
+void balancer_pool(struct balancer *b, int min_idle, int max_idle);
+
+/**
+ * @brief Start active health checks on a loop.
+ *
+ * Every backend is probed with a non-blocking connect each check_interval
+ * milliseconds. A backend is marked down when a probe or a session connect
+ * fails and up again when a probe succeeds.
+ *
+ * @param b Balancer.
+ * @param loop Event loop.
+ * @param interval Milliseconds between probes, 0 to disable them.
+ */
+void balancer_start(struct balancer *b, struct evloop *loop, unsigned long interval);
+
+/**
+ * @brief Choose a backend for a client.
+ *
+ * Down backends are skipped; if none is up, every backend is a candidate so
+ * that sessions are still attempted. Backends in tried are never picked, so
+ * retries reach each backend at most once even when all are down.
+ *
+ * @param b Balancer.
+ * @param client Client IPv4 address in network byte order.
+ * @param tried Backends the client already tried, bit i for backends[i].
+ * @return struct backend* The chosen backend, or NULL once every backend was tried.
+ */
+struct backend *balancer_pick(struct balancer *b, in_addr_t client, uint64_t tried);
+
+/**
+ * @brief Report a failed connection to a backend, marking it down.
+ */
+void backend_failed(struct backend *backend, int err);
+
+/**
+ * @brief Stop health checks and free the balancer.
+ */
+void balancer_close(struct balancer *b);
+
+#endif
@@ -0,0 +1,111 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Parse one route line, printing the reason on failure.
+ */
+static int parse_route(const char *path, int lineno, char *line, struct route_spec *spec) {
+    char *save = NULL;
+    char *name = strtok_r(line, " \t", &save);
+    char *port = strtok_r(NULL, " \t", &save);
+    char *action = strtok_r(NULL, " \t", &save);
+    char *arg = save != NULL ? save + strspn(save, " \t") : NULL;
+    char *end;
+
+    memset(spec, 0, sizeof(*spec));
+    if (name == NULL || port == NULL || action == NULL || arg == NULL || *arg == '\0') {
+        fprintf(stderr, "%s:%d: expected <name> <port> exec|proxy <argument>\n", path, lineno);
+        return -1;
+    }
+    if (strlen(name) >= sizeof(spec->name) || strlen(arg) >= sizeof(spec->arg)) {
+        fprintf(stderr, "%s:%d: route too long\n", path, lineno);
+        return -1;
+    }
+    strcpy(spec->name, name);
+    strcpy(spec->arg, arg);
+
+    spec->port = strtol(port, &end, 10);
+    if (*end != '\0' || spec->port <= 0 || spec->port > 65535) {
+        fprintf(stderr, "%s:%d: invalid port %s\n", path, lineno, port);
+        return -1;
+    }
+
+    if (strcmp(action, "exec") == 0) {
+        spec->action = ROUTE_EXEC;
+    } else if (strncmp(action, "proxy", 5) == 0 && (action[5] == '\0' || action[5] == ':')) {
+        spec->action = ROUTE_PROXY;
+        strcpy(spec->policy, "rr");
+        if (action[5] == ':') {
+            if (strlen(action + 6) >= sizeof(spec->policy)) {
+                fprintf(stderr, "%s:%d: invalid policy %s\n", path, lineno, action + 6);
+                return -1;
+            }
+            strcpy(spec->policy, action + 6);
+        }
+    } else {
+        fprintf(stderr, "%s:%d: unknown action %s, expected exec or proxy\n", path, lineno, action);
+        return -1;
+    }
+    return 0;
+}
+
+int config_load(const char *path, struct route_spec **specs) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    struct route_spec *routes = NULL;
+    int n = 0;
+    int lineno = 0;
+    char line[ROUTE_NAME_MAX + ROUTE_ARG_MAX + 64];
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *start = line + strspn(line, " \t");
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+        if (n == ROUTES_MAX) {
+            fprintf(stderr, "%s:%d: more than %d routes\n", path, lineno, ROUTES_MAX);
+            goto fail;
+        }
+
+        struct route_spec *grown = realloc(routes, (n + 1) * sizeof(*routes));
+        if (grown == NULL) {
+            perror("Allocation failed");
+            goto fail;
+        }
+        routes = grown;
+        if (parse_route(path, lineno, start, &routes[n]) == -1) {
+            goto fail;
+        }
+        for (int i = 0; i < n; i++) {
+            if (strcmp(routes[i].name, routes[n].name) == 0 || routes[i].port == routes[n].port) {
+                fprintf(stderr, "%s:%d: route %s clashes with route %s\n", path, lineno, routes[n].name,
+                        routes[i].name);
+                goto fail;
+            }
+        }
+        n++;
+    }
+
+    fclose(f);
+    *specs = routes;
+    return n;
+
+fail:
+    fclose(f);
+    free(routes);
+    return -1;
+}
+
+int route_spec_equal(const struct route_spec *a, const struct route_spec *b) {
+    return strcmp(a->name, b->name) == 0 && a->port == b->port && a->action == b->action &&
+           strcmp(a->policy, b->policy) == 0 && strcmp(a->arg, b->arg) == 0;
+}
@@ -0,0 +1,45 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define ROUTE_NAME_MAX 64
+#define ROUTE_ARG_MAX 1024
+#define ROUTES_MAX 1024
+
+enum route_action {
+    ROUTE_EXEC,   // Run a command per client, like -e with TCPMUXS
+    ROUTE_PROXY,  // Proxy every client to a backend, like -U
+};
+
+/**
+ * @brief One line of a daemon configuration: a listener and what serves it.
+ */
+struct route_spec {
+    char name[ROUTE_NAME_MAX];
+    int port;
+    enum route_action action;
+    char policy[16];          // Balancing policy of a proxy route
+    char arg[ROUTE_ARG_MAX];  // Command, or backends as accepted by -U
+};
+
+/**
+ * @brief Read a daemon configuration file.
+ *
+ * Every non-empty line that does not start with '#' declares a route:
+ *
+ *     <name> <port> exec <command and arguments>
+ *     <name> <port> proxy[:rr|least|hash] <ip,port or UDSCS<path>> ...
+ *
+ * Names and ports must be unique within the file.
+ *
+ * @param path Configuration file.
+ * @param specs Set to a heap allocated array of routes.
+ * @return int Number of routes, or -1 after printing the offending line.
+ */
+int config_load(const char *path, struct route_spec **specs);
+
+/**
+ * @brief Check whether two routes would be served the same way.
+ */
+int route_spec_equal(const struct route_spec *a, const struct route_spec *b);
+
+#endif
@@ -0,0 +1,312 @@
+#include "evloop.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EV_MAX_EVENTS 64
+#define EV_BUSY_POLL_BUDGET 8  // Packets per device queue poll, the kernel's default
+
+#ifndef EPIOCSPARAMS
+// Linux 6.9 uapi, missing from older headers
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+/**
+ * @brief Monotonic clock in microseconds.
+ */
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Unlink a timer from whatever wheel list it currently sits in.
+ *
+ * @param timer Linked timer.
+ */
+static void timer_unlink(struct ev_timer *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = timer;
+}
+
+/**
+ * @brief Append a timer to the tail of a wheel list.
+ *
+ * @param head Sentinel of the list.
+ * @param timer Timer to append.
+ */
+static void timer_link(struct ev_timer *head, struct ev_timer *timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+/**
+ * @brief Arm or disarm the periodic wheel tick depending on the timer count.
+ *
+ * The timerfd only runs while at least one timer is active, so an idle loop
+ * does not wake up at all.
+ *
+ * @param loop Event loop.
+ */
+static void update_tick(struct evloop *loop) {
+    int want = loop->ntimers > 0;
+    if (want == loop->tfd_armed) {
+        return;
+    }
+
+    struct itimerspec spec = {0};
+    if (want) {
+        spec.it_interval.tv_sec = loop->tick_ms / 1000;
+        spec.it_interval.tv_nsec = (long)(loop->tick_ms % 1000) * 1000000L;
+        spec.it_value = spec.it_interval;
+    }
+    timerfd_settime(loop->tfd, 0, &spec, NULL);
+    loop->tfd_armed = want;
+}
+
+/**
+ * @brief Advance the wheel by one slot and fire the timers that expired.
+ *
+ * @param loop Event loop.
+ */
+static void wheel_advance(struct evloop *loop) {
+    loop->cursor++;
+    struct ev_timer *head = &loop->slots[loop->cursor % EV_WHEEL_SLOTS];
+
+    // Detach the slot first so callbacks may freely re-arm timers into it
+    struct ev_timer pending;
+    pending.next = pending.prev = &pending;
+    if (head->next != head) {
+        pending.next = head->next;
+        pending.prev = head->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        head->next = head->prev = head;
+    }
+
+    while (pending.next != &pending) {
+        struct ev_timer *timer = pending.next;
+        timer_unlink(timer);
+        if (timer->rounds > 0) {
+            timer->rounds--;
+            timer_link(head, timer);
+            continue;
+        }
+        timer->active = 0;
+        loop->ntimers--;
+        timer->cb(loop, timer);
+    }
+}
+
+/**
+ * @brief Event callback of the wheel's timerfd.
+ */
+static void on_tick(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    uint64_t expirations;
+    if (read(io->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    while (expirations-- > 0 && !loop->stop) {
+        wheel_advance(loop);
+    }
+    update_tick(loop);
+}
+
+int ev_init(struct evloop *loop, unsigned tick_ms) {
+    memset(loop, 0, sizeof(*loop));
+    loop->tick_ms = tick_ms ? tick_ms : EV_DEFAULT_TICK_MS;
+    for (int i = 0; i < EV_WHEEL_SLOTS; i++) {
+        loop->slots[i].next = loop->slots[i].prev = &loop->slots[i];
+    }
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd == -1) {
+        return -1;
+    }
+    loop->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loop->tfd == -1) {
+        close(loop->epfd);
+        return -1;
+    }
+    if (ev_io_add(loop, &loop->tio, loop->tfd, EPOLLIN, on_tick, NULL) == -1) {
+        close(loop->tfd);
+        close(loop->epfd);
+        return -1;
+    }
+    return 0;
+}
+
+int ev_busy_poll(struct evloop *loop, unsigned spin_us) {
+    struct epoll_params params = {
+        .busy_poll_usecs = spin_us,
+        .busy_poll_budget = spin_us ? EV_BUSY_POLL_BUDGET : 0,
+        .prefer_busy_poll = spin_us != 0,
+    };
+    loop->spin_us = spin_us;
+    loop->last_event_us = now_us();
+    return ioctl(loop->epfd, EPIOCSPARAMS, &params);
+}
+
+void ev_close(struct evloop *loop) {
+    close(loop->tfd);
+    close(loop->epfd);
+}
+
+int ev_io_add(struct evloop *loop, struct ev_io *io, int fd, uint32_t events, ev_io_cb cb, void *arg) {
+    io->fd = fd;
+    io->events = events;
+    io->always_ready = 0;
+    io->cb = cb;
+    io->arg = arg;
+    io->next_ready = NULL;
+
+    struct epoll_event ev = {.events = events, .data.ptr = io};
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+        return 0;
+    }
+    if (errno != EPERM) {
+        return -1;
+    }
+
+    // Regular files cannot be polled; they are always readable and writable
+    io->always_ready = 1;
+    io->next_ready = loop->ready;
+    loop->ready = io;
+    return 0;
+}
+
+int ev_io_mod(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    if (io->events == events) {
+        return 0;
+    }
+    io->events = events;
+    if (io->always_ready) {
+        return 0;
+    }
+    struct epoll_event ev = {.events = events, .data.ptr = io};
+    return epoll_ctl(loop->epfd, EPOLL_CTL_MOD, io->fd, &ev);
+}
+
+void ev_io_del(struct evloop *loop, struct ev_io *io) {
+    // Drop pending events of this iteration so a freed watcher is never dispatched
+    for (int i = 0; i < loop->batch_len; i++) {
+        if (loop->batch[i].data.ptr == io) {
+            loop->batch[i].data.ptr = NULL;
+        }
+    }
+
+    if (io->always_ready) {
+        loop->ready_changed = 1;
+        for (struct ev_io **p = &loop->ready; *p != NULL; p = &(*p)->next_ready) {
+            if (*p == io) {
+                *p = io->next_ready;
+                break;
+            }
+        }
+        return;
+    }
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, io->fd, NULL);
+}
+
+void ev_timer_init(struct ev_timer *timer) {
+    memset(timer, 0, sizeof(*timer));
+    timer->next = timer->prev = timer;
+}
+
+void ev_timer_start(struct evloop *loop, struct ev_timer *timer, unsigned long ms, ev_timer_cb cb, void *arg) {
+    ev_timer_stop(loop, timer);
+
+    unsigned long ticks = (ms + loop->tick_ms - 1) / loop->tick_ms;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    timer->rounds = (ticks - 1) / EV_WHEEL_SLOTS;
+    timer->cb = cb;
+    timer->arg = arg;
+    timer->active = 1;
+    timer_link(&loop->slots[(loop->cursor + ticks) % EV_WHEEL_SLOTS], timer);
+    loop->ntimers++;
+    update_tick(loop);
+}
+
+void ev_timer_stop(struct evloop *loop, struct ev_timer *timer) {
+    if (!timer->active) {
+        return;
+    }
+    timer_unlink(timer);
+    timer->active = 0;
+    loop->ntimers--;
+    update_tick(loop);
+}
+
+int ev_run(struct evloop *loop) {
+    struct epoll_event events[EV_MAX_EVENTS];
+
+    loop->stop = 0;
+    while (!loop->stop) {
+        int timeout = -1;
+        for (struct ev_io *io = loop->ready; io != NULL; io = io->next_ready) {
+            if (io->events != 0) {
+                timeout = 0;
+                break;
+            }
+        }
+        if (timeout == -1 && loop->spin_us > 0 && now_us() - loop->last_event_us < loop->spin_us) {
+            timeout = 0;  // Still within the spin budget: poll again instead of sleeping
+        }
+
+        int n = epoll_wait(loop->epfd, events, EV_MAX_EVENTS, timeout);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n > 0 && loop->spin_us > 0) {
+            loop->last_event_us = now_us();
+        }
+
+        loop->batch = events;
+        loop->batch_len = n;
+        for (int i = 0; i < n && !loop->stop; i++) {
+            struct ev_io *io = events[i].data.ptr;
+            if (io != NULL) {
+                io->cb(loop, io, events[i].events);
+            }
+        }
+        loop->batch_len = 0;
+
+        // A callback may unregister ready watchers, so restart the walk when it does
+        loop->ready_changed = 0;
+        struct ev_io *io = loop->ready;
+        while (io != NULL && !loop->stop) {
+            struct ev_io *next = io->next_ready;
+            if (io->events != 0) {
+                io->cb(loop, io, io->events);
+            }
+            if (loop->ready_changed) {
+                break;
+            }
+            io = next;
+        }
+    }
+    return 0;
+}
+
+void ev_stop(struct evloop *loop) {
+    loop->stop = 1;
+}
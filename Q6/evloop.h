@@ -0,0 +1,173 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define EV_WHEEL_SLOTS 256    // Slots in the hashed timer wheel
+#define EV_DEFAULT_TICK_MS 100 // Default wheel resolution in milliseconds
+
+struct evloop;
+struct ev_io;
+struct ev_timer;
+
+typedef void (*ev_io_cb)(struct evloop *loop, struct ev_io *io, uint32_t events);
+typedef void (*ev_timer_cb)(struct evloop *loop, struct ev_timer *timer);
+
+/**
+ * @brief A file descriptor watched by the event loop.
+ *
+ * Callers embed this structure in their own state and recover it from the
+ * callback through the arg pointer.
+ */
+struct ev_io {
+    int fd;
+    uint32_t events;      // Currently requested EPOLLIN/EPOLLOUT mask
+    int always_ready;     // Set for fds epoll refuses (regular files)
+    ev_io_cb cb;
+    void *arg;
+    struct ev_io *next_ready;
+};
+
+/**
+ * @brief A one-shot timer kept in the loop's hashed timer wheel.
+ *
+ * Starting, stopping and re-arming are O(1); a wheel tick only visits the
+ * timers hashed into the current slot.
+ */
+struct ev_timer {
+    struct ev_timer *next;
+    struct ev_timer *prev;
+    unsigned long rounds; // Full wheel turns left before expiry
+    int active;
+    ev_timer_cb cb;
+    void *arg;
+};
+
+/**
+ * @brief An epoll based event loop with a timerfd driven timer wheel.
+ */
+struct evloop {
+    int epfd;
+    int tfd;                     // timerfd ticking the wheel while timers exist
+    unsigned tick_ms;
+    unsigned long cursor;        // Index of the last processed wheel slot
+    size_t ntimers;
+    int tfd_armed;
+    int stop;
+    struct ev_io tio;
+    struct ev_io *ready;         // Always-ready fds polled every iteration
+    int ready_changed;
+    struct epoll_event *batch;   // Events of the iteration being dispatched
+    int batch_len;
+    unsigned spin_us;            // Busy-poll budget before epoll_wait() blocks, 0 to block at once
+    long long last_event_us;     // When the last event was dispatched
+    struct ev_timer slots[EV_WHEEL_SLOTS];
+};
+
+/**
+ * @brief Initialize an event loop.
+ *
+ * @param loop Loop to initialize.
+ * @param tick_ms Timer wheel resolution, 0 selects EV_DEFAULT_TICK_MS.
+ * @return int 0 on success, -1 on failure with errno set.
+ */
+int ev_init(struct evloop *loop, unsigned tick_ms);
+
+/**
+ * @brief Busy-poll for events before blocking.
+ *
+ * After an event, the loop keeps polling epoll without sleeping for up to
+ * spin_us microseconds, so the next event is picked up without a wakeup.
+ * Only once that budget passes without events does epoll_wait() block
+ * again. The epoll instance is also asked to busy-poll the device queues of
+ * its sockets (EPIOCSPARAMS), which needs Linux 6.9 and sockets bound to a
+ * NAPI queue.
+ *
+ * @param loop Event loop.
+ * @param spin_us Spin budget in microseconds, 0 to always block.
+ * @return int 0 if the kernel busy-polls as well, -1 with errno set if only the loop spins.
+ */
+int ev_busy_poll(struct evloop *loop, unsigned spin_us);
+
+/**
+ * @brief Release the descriptors owned by the loop.
+ *
+ * @param loop Loop to close.
+ */
+void ev_close(struct evloop *loop);
+
+/**
+ * @brief Start watching a descriptor.
+ *
+ * @param loop Event loop.
+ * @param io Watcher to register.
+ * @param fd Descriptor to watch.
+ * @param events Initial EPOLLIN/EPOLLOUT interest.
+ * @param cb Callback invoked when the descriptor is ready.
+ * @param arg User pointer stored in the watcher.
+ * @return int 0 on success, -1 on failure with errno set.
+ */
+int ev_io_add(struct evloop *loop, struct ev_io *io, int fd, uint32_t events, ev_io_cb cb, void *arg);
+
+/**
+ * @brief Change the interest mask of a registered watcher.
+ *
+ * @param loop Event loop.
+ * @param io Registered watcher.
+ * @param events New EPOLLIN/EPOLLOUT interest.
+ * @return int 0 on success, -1 on failure with errno set.
+ */
+int ev_io_mod(struct evloop *loop, struct ev_io *io, uint32_t events);
+
+/**
+ * @brief Stop watching a descriptor. The descriptor itself is not closed.
+ *
+ * @param loop Event loop.
+ * @param io Registered watcher.
+ */
+void ev_io_del(struct evloop *loop, struct ev_io *io);
+
+/**
+ * @brief Initialize a timer so it can be stopped before ever being started.
+ *
+ * @param timer Timer to initialize.
+ */
+void ev_timer_init(struct ev_timer *timer);
+
+/**
+ * @brief (Re)arm a one-shot timer.
+ *
+ * @param loop Event loop.
+ * @param timer Timer to arm; an already active timer is moved.
+ * @param ms Delay in milliseconds, rounded up to the wheel resolution.
+ * @param cb Callback invoked on expiry.
+ * @param arg User pointer stored in the timer.
+ */
+void ev_timer_start(struct evloop *loop, struct ev_timer *timer, unsigned long ms, ev_timer_cb cb, void *arg);
+
+/**
+ * @brief Disarm a timer. Stopping an inactive timer is a no-op.
+ *
+ * @param loop Event loop.
+ * @param timer Timer to disarm.
+ */
+void ev_timer_stop(struct evloop *loop, struct ev_timer *timer);
+
+/**
+ * @brief Dispatch events until ev_stop() is called.
+ *
+ * @param loop Event loop.
+ * @return int 0 when stopped, -1 if epoll failed.
+ */
+int ev_run(struct evloop *loop);
+
+/**
+ * @brief Make ev_run() return after the current iteration.
+ *
+ * @param loop Event loop.
+ */
+void ev_stop(struct evloop *loop);
+
+#endif
@@ -0,0 +1,134 @@
+#include "handoff.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define LISTEN_FDS_START 3
+
+/**
+ * @brief Fill a Unix socket address, failing if the path does not fit.
+ */
+static int unix_addr(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+int handoff_receive(const char *path, int *fds, int max) {
+    struct sockaddr_un addr;
+    if (unix_addr(path, &addr) == -1) {
+        return -1;
+    }
+    int conn = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (conn == -1) {
+        return -1;
+    }
+    if (connect(conn, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        int saved = errno;
+        close(conn);
+        errno = saved;
+        // No socket, or a stale one left by a process that is gone
+        return errno == ENOENT || errno == ECONNREFUSED ? 0 : -1;
+    }
+
+    int n = 0;
+    int total;
+    do {
+        char control[CMSG_SPACE(HANDOFF_BATCH * sizeof(int))];
+        struct iovec iov = {.iov_base = &total, .iov_len = sizeof(total)};
+        struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control,
+                             .msg_controllen = sizeof(control)};
+        ssize_t len = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+        if (len != sizeof(total) || (msg.msg_flags & MSG_CTRUNC)) {
+            close(conn);
+            errno = len == -1 ? errno : EPROTO;
+            return -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            int count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int *received = (int *)CMSG_DATA(cm);
+            for (int i = 0; i < count; i++) {
+                if (n < max) {
+                    fds[n++] = received[i];
+                } else {
+                    close(received[i]);
+                }
+            }
+        }
+    } while (n < total && n < max);
+
+    close(conn);
+    return n;
+}
+
+int handoff_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (unix_addr(path, &addr) == -1) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    unlink(path);  // Nobody answered on it, or handoff_receive() would have taken it over
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 1) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+int handoff_send(int conn, const int *fds, int n) {
+    int sent = 0;
+    do {
+        int count = n - sent < HANDOFF_BATCH ? n - sent : HANDOFF_BATCH;
+        char control[CMSG_SPACE(HANDOFF_BATCH * sizeof(int))] = {0};
+        struct iovec iov = {.iov_base = &n, .iov_len = sizeof(n)};
+        struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control,
+                             .msg_controllen = CMSG_SPACE(count * sizeof(int))};
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(count * sizeof(int));
+        memcpy(CMSG_DATA(cm), fds + sent, count * sizeof(int));
+        if (sendmsg(conn, &msg, MSG_NOSIGNAL) == -1) {
+            return -1;
+        }
+        sent += count;
+    } while (sent < n);
+    return 0;
+}
+
+int listen_fds_inherited(int *fds, int max) {
+    const char *pid = getenv("LISTEN_PID");
+    const char *count = getenv("LISTEN_FDS");
+    int n = 0;
+
+    if (pid != NULL && count != NULL && atol(pid) == getpid()) {
+        n = atoi(count);
+        n = n < 0 ? 0 : n > max ? max : n;
+        for (int i = 0; i < n; i++) {
+            fds[i] = LISTEN_FDS_START + i;
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    return n;
+}
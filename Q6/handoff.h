@@ -0,0 +1,50 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#define HANDOFF_BATCH 64  // Descriptors per message, below the kernel's SCM_MAX_FD
+
+/**
+ * @brief Take over the listeners of a running mync that serves a handoff socket.
+ *
+ * Connects to the socket and receives the listeners through SCM_RIGHTS.
+ * The predecessor unlinks the socket before sending, so the caller may bind
+ * its own handoff socket at the same path right afterwards.
+ *
+ * @param path Path of the predecessor's handoff socket.
+ * @param fds Filled with the received listeners, close-on-exec.
+ * @param max Capacity of fds.
+ * @return int Number of listeners, 0 if nobody serves the path, -1 with errno set on failure.
+ */
+int handoff_receive(const char *path, int *fds, int max);
+
+/**
+ * @brief Serve a handoff socket at a path, replacing a stale one.
+ *
+ * @param path Filesystem path of the Unix socket.
+ * @return int The listening socket, or -1 with errno set.
+ */
+int handoff_listen(const char *path);
+
+/**
+ * @brief Pass listeners to a successor connected to the handoff socket.
+ *
+ * @param conn Accepted connection of the successor.
+ * @param fds Listeners to pass; the caller keeps its own copies.
+ * @param n Number of listeners.
+ * @return int 0 on success, -1 with errno set.
+ */
+int handoff_send(int conn, const int *fds, int n);
+
+/**
+ * @brief Collect listeners passed by a socket activation manager.
+ *
+ * Follows the LISTEN_PID/LISTEN_FDS convention: n listeners start at
+ * descriptor 3. The variables are removed so children do not claim them.
+ *
+ * @param fds Filled with the listeners, made close-on-exec.
+ * @param max Capacity of fds.
+ * @return int Number of listeners, 0 if none were passed to this process.
+ */
+int listen_fds_inherited(int *fds, int max);
+
+#endif
@@ -1,30 +1,171 @@
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
 #include <sys/select.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
+#include "balance.h"
+#include "config.h"
+#include "evloop.h"
+#include "handoff.h"
+#include "plugin.h"
+#include "record.h"
+#include "shm_ring.h"
+#include "sockmap.h"
+#include "supervise.h"
+#include "zcopy.h"
+
+#define BUFFER_SIZE 1024
+#define DRAIN_GRACE_MS 2000  // Time allowed to flush pending data after a timeout
+#define COALESCE_DEADLINE_US 200  // Default longest wait of a held chunk with -C
+
+static long long session_deadline = 0;   // CLOCK_MONOTONIC ms at which -t expires, 0 if unset
+static unsigned long idle_timeout = 0;   // -T idle timeout in ms, 0 if unset
+static int status_frames = 0;            // -S: send each connection its child's exit status
+static unsigned max_restarts = 0;        // -R: restarts allowed for a crashing child
+static struct recorder *capture = NULL;  // -c: capture file of relayed chunks
+static int listen_backlog = SOMAXCONN;   // -q: accept queue length of server sockets
+static int defer_accept = 0;             // -D: TCP_DEFER_ACCEPT seconds, 0 if unset
+static int max_sessions = 0;             // -m: concurrent TCPMUXS sessions, 0 for no limit
+static int max_per_ip = 0;               // -M: concurrent TCPMUXS sessions per client IP
+static struct plugin *handler = NULL;    // -E: in-process session handler instead of -e children
+static int kernel_relay = 0;             // -K: relay socket bridges through a BPF sockmap
+static struct balancer *balancer = NULL; // -U: TCPMUXS proxies every client to one of these backends
+static unsigned long health_interval = BALANCE_CHECK_MS;  // -H: ms between backend probes, 0 to disable
+static size_t coalesce_bytes = 0;        // -C: hold relayed chunks until this many bytes are buffered, 0 if unset
+static long coalesce_us = COALESCE_DEADLINE_US;  // -C: longest a held chunk waits for more
+static size_t zerocopy_min = 0;          // -Z: smallest write sent with MSG_ZEROCOPY, 0 if unset
+static int workers = 1;                  // -j: TCPMUXS worker processes
+static int worker_cpus[AFFINITY_MAX_CPUS];  // -a: CPUs to pin to, handed out to workers in order
+static int nworker_cpus = 0;
+static cpu_set_t original_cpus;          // Affinity before -a
+static const cpu_set_t *child_cpus = NULL;  // Affinity of -e children, NULL to keep mync's
+static int pin_children = 0;             // -A: -e children inherit the pinning of their worker
+static unsigned busy_poll_us = 0;        // -B: busy-poll this long after each event before sleeping, 0 if unset
+static char *handoff_path = NULL;        // -X: Unix socket to take over and hand off TCPMUXS listeners
+static char *config_path = NULL;         // -F: serve every route of this file from one daemon
+
+#define ACCEPT_BATCH_MAX 256   // Accepts per wakeup, so a storm cannot starve other events
+#define WORKERS_MAX 256
+#define BUSY_POLL_MAX_US 1000000
+#define HEALTH_INTERVAL_MAX_MS 86400000  // A day between probes (-H)
+#define POOL_IDLE_MAX 1024  // Warm connections per backend (-W)
+#define TIMEOUT_MAX_S 2592000  // Thirty days, for -t and -T
+#define DEFER_ACCEPT_MAX 3600  // Seconds a listener may hold a silent connection (-D)
+#define IP_BUCKETS 1024
+
+#define RESTARTS_MAX 1000000       // Cap on -R, far beyond any useful restart budget
+#define RESTART_BACKOFF_MS 100      // First restart delay, doubled on every crash
+#define RESTART_BACKOFF_MAX_MS 5000
+#define RESTART_RESET_MS 10000      // Uptime after which a child counts as healthy again
+
 /**
- * @brief Execute a command by creating a new process.
- * 
- * This function takes a command string, tokenizes it into arguments,
- * forks a new process, and executes the command in the child process.
- * 
- * @param args_as_string Command string to be executed.
+ * @brief One direction of a relayed session.
+ *
+ * Bytes read from src are kept in the buffer until dst accepted all of them,
+ * so a slow destination applies backpressure instead of losing data. With
+ * -C small chunks are also held back on purpose and merged into one write.
+ * With -Z a TCP destination is written from the zerocopy sender's slots
+ * instead of the inline buffer.
+ */
+struct relay_dir {
+    int src;
+    int dst;
+    char buffer[BUFFER_SIZE];
+    char *data;  // buffer, or the current zerocopy slot (NULL while all are in flight)
+    size_t cap;
+    size_t off;  // First byte of data not yet written
+    size_t len;  // Bytes still waiting to be written
+    int eof;
+    int held;    // The pending bytes wait for more to coalesce with, not for dst
+    int half_close;  // An EOF only shuts down dst, as a proxy must, instead of ending the session
+    int shut;    // dst was shut down after eof
+    struct zc_sender *zc;  // -Z sender of dst, or NULL
+};
+
+/**
+ * @brief A relayed session made of up to two directions over up to three descriptors.
+ *
+ * dirs[0] carries data towards the program or output endpoint and dirs[1]
+ * carries the replies, matching REC_DIR_IN and REC_DIR_OUT of a capture.
+ */
+struct session {
+    struct relay_dir dirs[2];
+    int ndirs;
+    struct ev_io ios[3];
+    int nios;
+    struct ev_timer idle_timer;
+    struct ev_timer session_timer;
+    struct ev_timer drain_timer;
+    int draining;
+    int failed;
+    int finished;
+    void (*on_end)(struct evloop *loop, struct session *s);  // Called once finished, instead of stopping the loop
+    void *arg;
+    int coalesce_fd;             // -C deadline timerfd, or -1
+    struct ev_io coalesce_io;
+    int coalesce_armed;
+};
+
+/**
+ * @brief Current CLOCK_MONOTONIC time in milliseconds.
+ *
+ * @return long long Milliseconds since an arbitrary fixed point.
+ */
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Milliseconds left until the -t deadline.
+ *
+ * @return long long Remaining time, 0 if expired, -1 if no deadline is set.
+ */
+static long long session_remaining(void) {
+    if (session_deadline == 0) {
+        return -1;
+    }
+    long long left = session_deadline - monotonic_ms();
+    return left > 0 ? left : 0;
+}
+
+/**
+ * @brief Split a command string into a NULL terminated argument vector.
+ *
+ * The string is tokenized in place, so it must outlive the returned vector.
+ *
+ * @param args_as_string Command string to split.
+ * @return char** Heap allocated argument vector.
  */
-void RUN(char *args_as_string) {
+char **split_command(char *args_as_string) {
     // Split the command string into tokens
     char *token = strtok(args_as_string, " ");
     if (token == NULL) {
@@ -43,25 +184,127 @@ void RUN(char *args_as_string) {
         args = (char **)realloc(args, (n + 1) * sizeof(char *));
         args[n++] = token;
     }
+    return args;
+}
+
+/**
+ * @brief Print how a child terminated, in the format used by Q2.
+ *
+ * @param status Wait status of the child.
+ */
+void report_child_status(int status) {
+    if (WIFEXITED(status)) {
+        fprintf(stderr, "Child exited with status %d\n", WEXITSTATUS(status));
+    } else if (WIFSIGNALED(status)) {
+        fprintf(stderr, "Child killed by signal %d\n", WTERMSIG(status));
+    }
+}
+
+/**
+ * @brief State shared by the callbacks that supervise a single -e child.
+ */
+struct child_watch {
+    struct child child;
+    int status;
+    int stop_on_exit;  // Leave the loop once the child is reaped
+    struct ev_timer session_timer;
+    struct ev_timer kill_timer;
+};
+
+/**
+ * @brief Record the child's wait status, leaving the loop if requested.
+ */
+static void on_child_exit(struct evloop *loop, struct child *child, int status) {
+    struct child_watch *watch = child->arg;
+    watch->status = status;
+    watch->child.pid = 0;
+    ev_timer_stop(loop, &watch->session_timer);
+    ev_timer_stop(loop, &watch->kill_timer);
+    if (watch->stop_on_exit) {
+        ev_stop(loop);
+    }
+}
+
+/**
+ * @brief Escalate to SIGKILL when the child ignored SIGTERM for the grace period.
+ */
+static void on_child_kill(struct evloop *loop, struct ev_timer *timer) {
+    struct child_watch *watch = timer->arg;
+    if (watch->child.pid == 0) {
+        return;
+    }
+    kill(watch->child.pid, SIGKILL);
+}
+
+/**
+ * @brief Ask the child to terminate when the -t session timeout expires.
+ */
+static void on_child_timeout(struct evloop *loop, struct ev_timer *timer) {
+    struct child_watch *watch = timer->arg;
+    if (watch->child.pid == 0) {
+        return;
+    }
+    fprintf(stderr, "Timeout expired, terminating child %d\n", watch->child.pid);
+    kill(watch->child.pid, SIGTERM);
+    ev_timer_start(loop, &watch->kill_timer, DRAIN_GRACE_MS, on_child_kill, watch);
+}
+
+/**
+ * @brief Execute a command by creating a new process.
+ * 
+ * This function takes a command string, tokenizes it into arguments,
+ * forks a new process, and executes the command in the child process.
+ * The child's exit is observed through the reaper's signalfd and the -t
+ * timeout through the event loop's timer wheel. On expiry the child gets
+ * SIGTERM followed by SIGKILL after DRAIN_GRACE_MS, so it is never orphaned.
+ * 
+ * @param args_as_string Command string to be executed.
+ * @param in_fd Child stdin.
+ * @param out_fd Child stdout.
+ * @return int The child's exit code, 128 + signal if it was killed.
+ */
+static int run_child(char *args_as_string, int in_fd, int out_fd) {
+    char **args = split_command(args_as_string);
+    struct child_watch watch = {.child = {.on_exit = on_child_exit, .arg = &watch}, .stop_on_exit = 1};
+    struct evloop loop;
+    struct reaper reaper;
+
+    if (ev_init(&loop, 0) == -1 || reaper_init(&reaper, &loop) == -1) {
+        perror("Event loop setup failed");
+        exit(EXIT_FAILURE);
+    }
+    reaper.child_cpus = child_cpus;
+    ev_timer_init(&watch.session_timer);
+    ev_timer_init(&watch.kill_timer);
 
     // Fork a new process to execute the command
-    int pid = fork();  // Forking to create a new process
-    if (pid < 0) {
+    if (reaper_spawn(&reaper, &watch.child, args, in_fd, out_fd) < 0) {
         perror("Fork failed");
         exit(EXIT_FAILURE);
     }
 
-    // In the child process, execute the command
-    if (pid == 0) {
-        execvp(args[0], args);  // Execute the command in the child process
-        perror("Execution failed");  // If execvp returns, it must have failed
-        free(args);  // Free the allocated memory
-        exit(EXIT_FAILURE);
-    } else {
-        // In the parent process, wait for the child to complete
-        wait(NULL);  // Wait for the child process to finish
-        free(args);  // Free the allocated memory
+    long long remaining = session_remaining();
+    if (remaining >= 0) {
+        ev_timer_start(&loop, &watch.session_timer, remaining, on_child_timeout, &watch);
     }
+    ev_run(&loop);  // Runs until the reaper reports the child's exit
+
+    reaper_close(&reaper, &loop);
+    ev_close(&loop);
+    free(args);  // Free the allocated memory
+
+    report_child_status(watch.status);
+    return exit_code(watch.status);
+}
+
+/**
+ * @brief Execute a command on mync's own stdin and stdout.
+ *
+ * @param args_as_string Command string to be executed.
+ * @return int The child's exit code, 128 + signal if it was killed.
+ */
+int RUN(char *args_as_string) {
+    return run_child(args_as_string, STDIN_FILENO, STDOUT_FILENO);
 }
 
 /**
@@ -82,30 +325,63 @@ void close_descriptors(int *descriptors) {
 }
 
 /**
- * @brief Signal handler for alarm signal.
- * 
- * This function handles the SIGALRM signal to terminate the process.
- * 
- * @param sig The signal number.
+ * @brief Wait until a descriptor is readable, honouring the -t deadline.
+ *
+ * Used before blocking accept/recvfrom calls during setup. If the session
+ * timeout expires first there is nothing to drain yet, so the process exits.
+ *
+ * @param fd Descriptor to wait on.
+ * @param descriptors Descriptors to close on timeout.
  */
-void handle_alarm(int sig) {
-    exit(EXIT_FAILURE);  // Exit the process when the alarm signal is received
+void await_readable(int fd, int *descriptors) {
+    long long remaining = session_remaining();
+    if (remaining < 0) {
+        return;
+    }
+
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ret;
+    do {
+        ret = poll(&pfd, 1, (int)session_remaining());
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == 0) {
+        fprintf(stderr, "Timeout expired\n");
+        close(fd);
+        close_descriptors(descriptors);
+        exit(EXIT_FAILURE);
+    }
 }
 
 /**
- * @brief Setup a TCP server socket and accept a client connection.
- * 
- * This function creates a TCP server socket, binds it to a specified port,
- * listens for incoming connections, and accepts a client connection.
- * The client socket is stored in the provided descriptors array.
- * 
- * @param descriptors Array to store the input and output descriptors.
- * @param port Port number to bind the server socket.
- * @param b_flag Binding flag (can be NULL).
- * @param flag Indicates whether to set the input or output descriptor.
+ * @brief Put a descriptor in non-blocking mode if it is a socket.
+ *
+ * Standard streams are left alone since their file description is usually
+ * shared with the invoking shell.
+ *
+ * @param fd Descriptor to configure.
  */
-void TCP_SERVER(int *descriptors, int port, char *b_flag, int flag) {
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+void set_nonblocking_socket(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+}
+
+/**
+ * @brief Create a TCP listening socket, optionally one of a SO_REUSEPORT group.
+ *
+ * SO_INCOMING_CPU makes the kernel prefer the socket for connections
+ * received on its CPU when no steering program is attached to the group.
+ *
+ * @param descriptors Descriptors to close if setup fails.
+ * @param port Port number shared by the group.
+ * @param reuseport Join the port's SO_REUSEPORT group.
+ * @param cpu CPU served by the socket, -1 if it serves any.
+ * @return int The listening socket.
+ */
+int TCP_LISTENER_GROUP(int *descriptors, int port, int reuseport, int cpu) {
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (server_fd < 0) {
         perror("Socket creation failed");
         close_descriptors(descriptors);
@@ -120,6 +396,13 @@ void TCP_SERVER(int *descriptors, int port, char *b_flag, int flag) {
         close_descriptors(descriptors);
         exit(EXIT_FAILURE);
     }
+    if ((reuseport && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == -1) ||
+        (cpu >= 0 && setsockopt(server_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == -1)) {
+        perror("Set socket option failed");
+        close(server_fd);
+        close_descriptors(descriptors);
+        exit(EXIT_FAILURE);
+    }
 
     struct sockaddr_in server_addr = {0};
     server_addr.sin_family = AF_INET;
@@ -133,14 +416,49 @@ void TCP_SERVER(int *descriptors, int port, char *b_flag, int flag) {
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_fd, 1) < 0) {
+    // Only wake the acceptor once the client sent data (opt-in: ttt speaks first)
+    if (defer_accept > 0 &&
+        setsockopt(server_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_accept, sizeof(defer_accept)) == -1) {
+        perror("Set TCP_DEFER_ACCEPT failed");
+    }
+
+    if (listen(server_fd, listen_backlog) < 0) {
         perror("Listen failed");
         close_descriptors(descriptors);
         exit(EXIT_FAILURE);
     }
+    return server_fd;
+}
+
+/**
+ * @brief Create a TCP socket listening on a port.
+ *
+ * @param descriptors Descriptors to close if setup fails.
+ * @param port Port number to bind the server socket.
+ * @return int The listening socket.
+ */
+int TCP_LISTENER(int *descriptors, int port) {
+    return TCP_LISTENER_GROUP(descriptors, port, 0, -1);
+}
+
+/**
+ * @brief Setup a TCP server socket and accept a client connection.
+ * 
+ * This function creates a TCP server socket, binds it to a specified port,
+ * listens for incoming connections, and accepts a client connection.
+ * The client socket is stored in the provided descriptors array.
+ * 
+ * @param descriptors Array to store the input and output descriptors.
+ * @param port Port number to bind the server socket.
+ * @param b_flag Binding flag (can be NULL).
+ * @param flag Indicates whether to set the input or output descriptor.
+ */
+void TCP_SERVER(int *descriptors, int port, char *b_flag, int flag) {
+    int server_fd = TCP_LISTENER(descriptors, port);
 
     struct sockaddr_in client_addr;
     socklen_t client_len = sizeof(client_addr);
+    await_readable(server_fd, descriptors);
     int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
     if (client_fd < 0) {
         perror("Accept failed");
@@ -227,10 +545,9 @@ void TCP_client(int *descriptors, char *ip, int port, char *bvalue, int flag) {
  * 
  * @param descriptors Array to store the input and output descriptors.
  * @param port Port number to bind the server socket.
- * @param timeout Timeout value in seconds.
  * @param flag Indicates whether to set the input or output descriptor.
  */
-void UDP_SERVER(int *descriptors, int port, int timeout, int flag) {
+void UDP_SERVER(int *descriptors, int port, int flag) {
     int server_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (server_fd == -1) {
         perror("Socket creation failed");
@@ -261,6 +578,7 @@ void UDP_SERVER(int *descriptors, int port, int timeout, int flag) {
     struct sockaddr_in client_addr;
     socklen_t client_addr_len = sizeof(client_addr);
 
+    await_readable(server_fd, descriptors);
     int numbytes = recvfrom(server_fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&client_addr, &client_addr_len);
     if (numbytes == -1) {
         perror("Receive failed");
@@ -284,7 +602,6 @@ void UDP_SERVER(int *descriptors, int port, int timeout, int flag) {
     } else {
         descriptors[1] = server_fd;  // Set the output descriptor to the server socket
     }
-    alarm(timeout);  // Set an alarm to handle timeout
 }
 
 /**
@@ -366,7 +683,7 @@ void UDS_SERVER_STREAM(char *path, int *descriptors) {
 
     printf("UDS server socket bound\n");
 
-    if (listen(server_fd, 1) == -1) {
+    if (listen(server_fd, listen_backlog) == -1) {
         perror("Listen failed");
         close_descriptors(descriptors);
         exit(EXIT_FAILURE);
@@ -376,6 +693,7 @@ void UDS_SERVER_STREAM(char *path, int *descriptors) {
 
     struct sockaddr_un client_addr;
     socklen_t client_len = sizeof(client_addr);
+    await_readable(server_fd, descriptors);
     int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
     if (client_fd == -1) {
         perror("Accept failed");
@@ -421,128 +739,3163 @@ void UDS_CLIENT_STREAM(char *path, int *descriptors) {
 }
 
 /**
- * @brief Main function to handle command-line arguments and execute corresponding actions.
- * 
- * This function processes command-line arguments, sets up necessary sockets (TCP, UDP, UDS),
- * handles optional timeout, and manages input/output redirection for executing commands.
- * 
- * @param argc Argument count.
- * @param argv Argument vector.
- * @return int Exit status.
+ * @brief Find the watcher a session registered for a descriptor.
+ *
+ * @param s Session.
+ * @param fd Descriptor to look up.
+ * @return struct ev_io* The watcher, or NULL if the descriptor is unknown.
  */
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
-        exit(EXIT_FAILURE);
+static struct ev_io *session_io(struct session *s, int fd) {
+    for (int i = 0; i < s->nios; i++) {
+        if (s->ios[i].fd == fd) {
+            return &s->ios[i];
+        }
     }
+    return NULL;
+}
 
-    int opt;
-    char *evalue = NULL;
-    char *bvalue = NULL;
-    char *ivalue = NULL;
-    char *ovalue = NULL;
-    char *tvalue = NULL;
+/**
+ * @brief Finish the session, optionally marking it as failed.
+ *
+ * A session without an on_end callback owns its loop and stops it. One that
+ * shares the loop is reported through session_ended() once the callback that
+ * finished it is about to return.
+ */
+static void session_finish(struct evloop *loop, struct session *s, int failed) {
+    s->failed |= failed;
+    s->finished = 1;
+    ev_timer_stop(loop, &s->idle_timer);
+    ev_timer_stop(loop, &s->session_timer);
+    ev_timer_stop(loop, &s->drain_timer);
+    if (s->on_end == NULL) {
+        ev_stop(loop);
+    }
+}
 
-    while ((opt = getopt(argc, argv, "e:b:i:o:t:")) != -1) {
-        switch (opt) {
-            case 'e':
-                evalue = optarg;
-                break;
-            case 'b':
-                bvalue = optarg;
-                break;
-            case 'i':
-                ivalue = optarg;
-                break;
-            case 'o':
-                ovalue = optarg;
-                break;
-            case 't':
-                tvalue = optarg;
-                break;
-            default:
-                fprintf(stderr, "Usage: %s <port>\n", argv[0]);
-                exit(EXIT_FAILURE);
+/**
+ * @brief Hand a finished session to its on_end callback, which may free it.
+ *
+ * @return int Non-zero if the session finished.
+ */
+static int session_ended(struct evloop *loop, struct session *s) {
+    if (!s->finished) {
+        return 0;
+    }
+    if (s->on_end != NULL) {
+        s->on_end(loop, s);
+    }
+    return 1;
+}
+
+/**
+ * @brief Recompute the epoll interest of every descriptor of a session.
+ *
+ * A source is only read while its direction's buffer is empty or held for
+ * coalescing, and a destination is only watched for writability while
+ * data is pending. Zerocopy slots the kernel still references count as
+ * pending, so a drain waits for their completions.
+ * A draining session finishes as soon as nothing is pending.
+ *
+ * @param loop Event loop.
+ * @param s Session.
+ */
+static void session_update(struct evloop *loop, struct session *s) {
+    int pending = 0;
+    uint32_t events[3] = {0, 0, 0};
+
+    for (int d = 0; d < s->ndirs; d++) {
+        struct relay_dir *dir = &s->dirs[d];
+        for (int i = 0; i < s->nios; i++) {
+            if (s->ios[i].fd == dir->src && !dir->eof && !s->draining && (dir->len == 0 || dir->held) &&
+                dir->data != NULL) {
+                events[i] |= EPOLLIN;
+            }
+            if (s->ios[i].fd == dir->dst && dir->len > 0 && !dir->held) {
+                events[i] |= EPOLLOUT;
+            }
         }
+        pending |= dir->len > 0 || (dir->zc != NULL && zc_busy(dir->zc));
     }
 
-    if (tvalue != NULL) {
-        signal(SIGALRM, handle_alarm);  // Set the alarm signal handler
-        alarm(atoi(tvalue));  // Set the alarm with the given timeout value
+    if (s->draining && !pending) {
+        session_finish(loop, s, 0);
+        return;
     }
+    for (int i = 0; i < s->nios; i++) {
+        ev_io_mod(loop, &s->ios[i], events[i]);
+    }
+}
 
-    int descriptors[2] = {STDIN_FILENO, STDOUT_FILENO};
+/**
+ * @brief Give up on a drain that did not complete within DRAIN_GRACE_MS.
+ */
+static void on_drain_timeout(struct evloop *loop, struct ev_timer *timer) {
+    struct session *s = timer->arg;
+    fprintf(stderr, "Drain timeout expired, dropping pending data\n");
+    session_finish(loop, s, 1);
+    session_ended(loop, s);
+}
 
-    if (bvalue != NULL && (ivalue != NULL || ovalue != NULL)) {
-        fprintf(stderr, "Option -b cannot be used with -i or -o\n");
-        fprintf(stderr, "Usage: %s -e <value> [-b <value>] [-i <value>] [-o <value>]\n", argv[0]);
-        exit(EXIT_FAILURE);
+/**
+ * @brief Stop reading and let pending data flush before the session closes.
+ *
+ * @param loop Event loop.
+ * @param s Session.
+ */
+static void session_drain(struct evloop *loop, struct session *s) {
+    if (s->draining) {
+        return;
     }
+    s->draining = 1;
+    for (int d = 0; d < s->ndirs; d++) {
+        s->dirs[d].held = 0;  // Nothing more will join them
+    }
+    ev_timer_stop(loop, &s->idle_timer);
+    ev_timer_stop(loop, &s->session_timer);
+    ev_timer_start(loop, &s->drain_timer, DRAIN_GRACE_MS, on_drain_timeout, s);
+    session_update(loop, s);
+}
 
-    if (ivalue != NULL) {
-        printf("Processing -i option: %s\n", ivalue);
-        if (strncmp(ivalue, "TCPS", 4) == 0) {
-            ivalue += 4;
-            int port = atoi(ivalue);
-            TCP_SERVER(descriptors, port, NULL, 0);  // Setup TCP server
-        } else if (strncmp(ivalue, "UDPS", 4) == 0) {
-            ivalue += 4;
-            int port = atoi(ivalue);
-            if (tvalue != NULL) {
-                UDP_SERVER(descriptors, port, atoi(tvalue), 0);  // Setup UDP server with timeout
-            } else {
-                UDP_SERVER(descriptors, port, 0, 0);  // Setup UDP server without timeout
-            }
-        } else if (strncmp(ivalue, "UDSSS", 5) == 0) {
-            ivalue += 5;
-            printf("Unix Domain Socket Server Path: %s\n", ivalue);
-            UDS_SERVER_STREAM(ivalue, descriptors);  // Setup UDS server
-        } else if (strncmp(ivalue, "UDSCS", 5) == 0) {
-            ivalue += 5;
-            UDS_CLIENT_STREAM(ivalue, descriptors);  // Setup UDS client
-            descriptors[0] = descriptors[1];
-            descriptors[1] = STDOUT_FILENO;
-        } else if (strncmp(ivalue, "TCPC", 4) == 0) {
-            ivalue += 4;
-            char *ip_server = strtok(ivalue, ",");
-            if (ip_server == NULL) {
-                fprintf(stderr, "Invalid server IP\n");
-                close_descriptors(descriptors);
-                exit(EXIT_FAILURE);
-            }
-            char *port_server = strtok(NULL, ",");
-            if (port_server == NULL) {
-                fprintf(stderr, "Invalid server port\n");
-                close_descriptors(descriptors);
-                exit(EXIT_FAILURE);
-            }
-            int port = atoi(port_server);
-            TCP_client(descriptors, ip_server, port, NULL, 1);  // Setup TCP client
-        } else if (strncmp(ivalue, "UDPC", 4) == 0) {
-            ivalue += 4;
-            char *ip_server = strtok(ivalue, ",");
-            if (ip_server == NULL) {
-                fprintf(stderr, "Invalid server IP\n");
-                close_descriptors(descriptors);
-                exit(EXIT_FAILURE);
+/**
+ * @brief Idle (-T) or session (-t) timeout of a relayed session.
+ */
+static void on_session_timeout(struct evloop *loop, struct ev_timer *timer) {
+    struct session *s = timer->arg;
+    fprintf(stderr, "%s timeout expired\n", timer == &s->idle_timer ? "Idle" : "Session");
+    session_drain(loop, s);
+    session_ended(loop, s);
+}
+
+/**
+ * @brief Write as much of a direction's pending buffer as the destination accepts.
+ *
+ * @param dir Relay direction.
+ * @return int 0 on success (possibly partial), -1 on a write error.
+ */
+static int relay_flush(struct relay_dir *dir) {
+    while (dir->len > 0) {
+        ssize_t n = dir->zc != NULL ? zc_write(dir->zc, dir->data + dir->off, dir->len)
+                                    : write(dir->dst, dir->data + dir->off, dir->len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
             }
-            char *port_server = strtok(NULL, ",");
-            if (port_server == NULL) {
-                fprintf(stderr, "Invalid server port\n");
-                close_descriptors(descriptors);
-                exit(EXIT_FAILURE);
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
             }
-            int port = atoi(port_server);
-            UDP_CLIENT(descriptors, ip_server, port, 1);  // Setup UDP client
-        } else {
-            fprintf(stderr, "Invalid -i value\n");
-            exit(EXIT_FAILURE);
+            perror("Write failed");
+            return -1;
         }
+        dir->off += n;
+        dir->len -= n;
     }
-
-    if (ovalue != NULL) {
+    dir->off = 0;
+    if (dir->zc != NULL) {
+        zc_release(dir->zc);
+        dir->data = zc_buffer(dir->zc);
+    }
+    return 0;
+}
+
+/**
+ * @brief Signal EOF on a descriptor that is still read from the other side.
+ *
+ * Sockets are shut down for writing. A PTY master, told apart from a plain
+ * terminal by TIOCGPTN, cannot be: the slave's reader gets VEOF instead, as
+ * if ^D was typed, twice in canonical mode so that a partial line is
+ * completed first. The descriptor stays open, so the child's output can
+ * still be read.
+ *
+ * @param fd Socket or PTY master.
+ */
+void send_eof(int fd) {
+    struct termios tio;
+    unsigned pty;
+    if (ioctl(fd, TIOCGPTN, &pty) == 0 && tcgetattr(fd, &tio) == 0) {
+        char eof[2] = {tio.c_cc[VEOF], tio.c_cc[VEOF]};
+        if (write(fd, eof, (tio.c_lflag & ICANON) ? 2 : 1) == -1) {
+            perror("Write failed");
+        }
+        return;
+    }
+    shutdown(fd, SHUT_WR);
+}
+
+/**
+ * @brief Pass a half-closing direction's EOF on once its buffer is flushed.
+ */
+static void session_shut(struct relay_dir *dir) {
+    if (dir->half_close && dir->eof && dir->len == 0 && !dir->shut) {
+        send_eof(dir->dst);
+        dir->shut = 1;
+    }
+}
+
+/**
+ * @brief Handle the end of a direction's source.
+ *
+ * The whole session drains, unless the direction is half-closing: then only
+ * its destination is shut down, as soon as what was read before is flushed,
+ * and the session drains once every direction has ended.
+ */
+static void session_eof(struct evloop *loop, struct session *s, struct relay_dir *dir) {
+    dir->eof = 1;
+    dir->held = 0;
+    if (dir->half_close) {
+        session_shut(dir);
+        for (int d = 0; d < s->ndirs; d++) {
+            if (!s->dirs[d].eof) {
+                return;
+            }
+        }
+    }
+    session_drain(loop, s);
+}
+
+/**
+ * @brief Check whether a descriptor is still read or written by a session.
+ */
+static int session_uses(struct session *s, int fd) {
+    for (int d = 0; d < s->ndirs; d++) {
+        if ((s->dirs[d].src == fd && !s->dirs[d].eof) || (s->dirs[d].dst == fd && s->dirs[d].len > 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Start the -C deadline of the chunks just held, unless it is running.
+ */
+static void session_arm_coalesce(struct session *s) {
+    if (s->coalesce_armed) {
+        return;
+    }
+    struct itimerspec spec = {.it_value = {coalesce_us / 1000000, coalesce_us % 1000000 * 1000}};
+    timerfd_settime(s->coalesce_fd, 0, &spec, NULL);
+    s->coalesce_armed = 1;
+}
+
+/**
+ * @brief -C deadline: write every held chunk, however small.
+ */
+static void on_coalesce_timer(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct session *s = io->arg;
+    uint64_t expirations;
+    if (read(s->coalesce_fd, &expirations, sizeof(expirations)) == -1) {
+        return;
+    }
+    s->coalesce_armed = 0;
+
+    for (int d = 0; d < s->ndirs && !s->finished; d++) {
+        struct relay_dir *dir = &s->dirs[d];
+        if (dir->held) {
+            dir->held = 0;
+            if (relay_flush(dir) == -1) {
+                session_finish(loop, s, 1);
+            }
+        }
+    }
+    if (!s->finished && !loop->stop) {
+        session_update(loop, s);
+    }
+    session_ended(loop, s);
+}
+
+/**
+ * @brief Relay whatever a readiness event of one descriptor allows.
+ */
+static void session_handle_io(struct evloop *loop, struct session *s, struct ev_io *io, uint32_t events) {
+    // Zerocopy completions are queued as socket errors
+    for (int d = 0; d < s->ndirs && (events & EPOLLERR); d++) {
+        struct relay_dir *dir = &s->dirs[d];
+        if (dir->zc != NULL && dir->dst == io->fd) {
+            if (zc_reap(dir->zc) == -1) {
+                perror("Write failed");
+                session_finish(loop, s, 1);
+                return;
+            }
+            if (dir->data == NULL) {
+                dir->data = zc_buffer(dir->zc);
+            }
+            events &= ~EPOLLERR;
+        }
+    }
+
+    // Errors and hangups are reported even without interest; on a descriptor
+    // the session no longer uses they would be reported forever
+    if ((events & (EPOLLERR | EPOLLHUP)) && !session_uses(s, io->fd)) {
+        for (int d = 0; d < s->ndirs; d++) {
+            if (s->dirs[d].dst == io->fd && !s->dirs[d].eof) {
+                session_finish(loop, s, (events & EPOLLERR) != 0);  // Nothing more can be written to it
+                return;
+            }
+        }
+        ev_io_mod(loop, io, 0);
+        ev_io_del(loop, io);
+        return;
+    }
+
+    for (int d = 0; d < s->ndirs; d++) {
+        struct relay_dir *dir = &s->dirs[d];
+
+        if (dir->dst == io->fd && dir->len > 0 && !dir->held && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            if (relay_flush(dir) == -1) {
+                session_finish(loop, s, 1);
+                return;
+            }
+            session_shut(dir);
+        }
+
+        if (dir->src == io->fd && (dir->len == 0 || dir->held) && !dir->eof && !s->draining &&
+            (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            char *tail = dir->data + dir->off + dir->len;
+            ssize_t n = read(dir->src, tail, dir->data + dir->cap - tail);
+            if (n == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    continue;
+                }
+                if (errno == EIO) {
+                    // A PTY master reports EIO once the slave side is closed
+                    session_eof(loop, s, dir);
+                    continue;
+                }
+                perror("Read failed");
+                session_finish(loop, s, 1);
+                return;
+            }
+            if (n == 0) {
+                session_eof(loop, s, dir);
+                continue;
+            }
+            dir->len += n;
+            if (capture != NULL && recorder_write(capture, d, tail, n) == -1) {
+                perror("Capture failed");
+                capture = NULL;
+            }
+            if (idle_timeout > 0) {
+                ev_timer_start(loop, &s->idle_timer, idle_timeout, on_session_timeout, s);
+            }
+            if (s->coalesce_fd != -1 && dir->len < coalesce_bytes) {
+                dir->held = 1;
+                session_arm_coalesce(s);
+                continue;
+            }
+            dir->held = 0;
+            if (relay_flush(dir) == -1) {
+                session_finish(loop, s, 1);
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Readiness callback shared by all descriptors of a session.
+ */
+static void on_session_io(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct session *s = io->arg;
+
+    session_handle_io(loop, s, io, events);
+    if (!s->finished && !loop->stop) {
+        session_update(loop, s);
+    }
+    session_ended(loop, s);
+}
+
+/**
+ * @brief Register a relay direction with a session.
+ */
+static void session_add_dir(struct session *s, int src, int dst) {
+    struct relay_dir *dir = &s->dirs[s->ndirs++];
+    dir->src = src;
+    dir->dst = dst;
+    dir->data = dir->buffer;
+    dir->cap = sizeof(dir->buffer);
+    dir->off = dir->len = 0;
+    dir->eof = 0;
+    dir->half_close = 0;
+
+    int fds[2] = {src, dst};
+    for (int i = 0; i < 2; i++) {
+        if (session_io(s, fds[i]) == NULL) {
+            s->ios[s->nios++].fd = fds[i];
+        }
+    }
+}
+
+/**
+ * @brief Reset a session before directions are added to it.
+ *
+ * @param s Session.
+ */
+static void session_init(struct session *s) {
+    memset(s, 0, sizeof(*s));
+    s->coalesce_fd = -1;
+    ev_timer_init(&s->idle_timer);
+    ev_timer_init(&s->session_timer);
+    ev_timer_init(&s->drain_timer);
+}
+
+/**
+ * @brief Make a session's loop and sockets busy-poll instead of sleeping.
+ *
+ * The loop spins for busy_poll_us after each event. Sockets get the same
+ * budget for blocking reads of the device queue and prefer busy polling
+ * over interrupts, and TCP_NODELAY, so no write waits for an ACK. Kernel
+ * support is best effort; the loop spins even where it is refused.
+ *
+ * @param loop Event loop.
+ * @param s Session with all its directions added.
+ */
+static void session_busy_poll(struct evloop *loop, struct session *s) {
+    static int warned = 0;
+    int failed = ev_busy_poll(loop, busy_poll_us) == -1;
+    int budget = busy_poll_us;
+    int one = 1;
+
+    for (int i = 0; i < s->nios; i++) {
+        int fd = s->ios[i].fd;
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &budget, sizeof(budget)) == -1) {
+            if (errno == ENOTSOCK) {
+                continue;
+            }
+            failed = 1;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (failed && !warned) {
+        perror("Warning: kernel busy polling unavailable, spinning in mync only");
+        warned = 1;
+    }
+}
+
+/**
+ * @brief Register a session's descriptors and timers with a loop.
+ *
+ * @param loop Event loop.
+ * @param s Session with all its directions added.
+ * @return int 0 on success, -1 on failure.
+ */
+static int session_start(struct evloop *loop, struct session *s) {
+    for (int i = 0; i < s->nios; i++) {
+        set_nonblocking_socket(s->ios[i].fd);
+        if (ev_io_add(loop, &s->ios[i], s->ios[i].fd, 0, on_session_io, s) == -1) {
+            perror("Event registration failed");
+            return -1;
+        }
+    }
+
+    if (busy_poll_us > 0) {
+        session_busy_poll(loop, s);
+    }
+
+    if (coalesce_bytes > 0) {
+        s->coalesce_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (s->coalesce_fd == -1 ||
+            ev_io_add(loop, &s->coalesce_io, s->coalesce_fd, EPOLLIN, on_coalesce_timer, s) == -1) {
+            perror("Coalescing timer setup failed");
+            return -1;
+        }
+        // Batching now happens here, so Nagle must not add its own delay on top
+        int one = 1;
+        for (int i = 0; i < s->nios; i++) {
+            setsockopt(s->ios[i].fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    }
+
+    for (int d = 0; d < s->ndirs && zerocopy_min > 0; d++) {
+        struct relay_dir *dir = &s->dirs[d];
+        struct zc_sender *zc = malloc(sizeof(*zc));
+        if (zc == NULL || zc_init(zc, dir->dst, zerocopy_min) == -1) {
+            if (zc != NULL && errno != ENOTSOCK && errno != EOPNOTSUPP) {
+                perror("Zerocopy setup failed, copying instead");
+            }
+            free(zc);
+            continue;
+        }
+        dir->zc = zc;
+        dir->data = zc_buffer(zc);
+        dir->cap = ZC_SLOT_SIZE;
+    }
+
+    long long remaining = session_remaining();
+    if (remaining >= 0) {
+        ev_timer_start(loop, &s->session_timer, remaining, on_session_timeout, s);
+    }
+    if (idle_timeout > 0) {
+        ev_timer_start(loop, &s->idle_timer, idle_timeout, on_session_timeout, s);
+    }
+    session_update(loop, s);
+    return 0;
+}
+
+/**
+ * @brief Unregister a finished session and half-close its sockets.
+ *
+ * @param loop Event loop.
+ * @param s Session.
+ */
+static void session_stop(struct evloop *loop, struct session *s) {
+    ev_timer_stop(loop, &s->idle_timer);
+    ev_timer_stop(loop, &s->session_timer);
+    ev_timer_stop(loop, &s->drain_timer);
+    if (s->coalesce_fd != -1) {
+        ev_io_del(loop, &s->coalesce_io);
+        close(s->coalesce_fd);
+        s->coalesce_fd = -1;
+    }
+    for (int d = 0; d < s->ndirs; d++) {
+        struct zc_sender *zc = s->dirs[d].zc;
+        if (zc == NULL) {
+            continue;
+        }
+        if (zc->sends > 0) {
+            fprintf(stderr, "Zerocopy: %lu sends, %lu bytes, %lu copied by the kernel%s\n", zc->sends, zc->bytes,
+                    zc->copied, zc->disabled ? ", fell back to copying" : "");
+        }
+        zc_close(zc);
+        free(zc);
+        s->dirs[d].zc = NULL;
+    }
+
+    // Signal EOF to socket peers so nothing in flight is cut off by the close
+    for (int i = 0; i < s->nios; i++) {
+        if (s->ios[i].fd != -1) {
+            ev_io_del(loop, &s->ios[i]);
+            shutdown(s->ios[i].fd, SHUT_WR);
+        }
+    }
+}
+
+/**
+ * @brief Take a descriptor out of a finished session, leaving it open for reuse.
+ *
+ * @param loop Event loop.
+ * @param s Finished session.
+ * @param fd Descriptor session_stop() must not shut down.
+ */
+static void session_detach(struct evloop *loop, struct session *s, int fd) {
+    struct ev_io *io = session_io(s, fd);
+    if (io != NULL) {
+        ev_io_del(loop, io);
+        io->fd = -1;
+    }
+}
+
+/**
+ * @brief Check whether a finished session left a descriptor clean for reuse.
+ *
+ * It must have ended without errors while both directions were still open
+ * (after an idle timeout, say) and with nothing left in flight. That is a
+ * clean break in the byte stream, not a protocol boundary.
+ */
+static int session_reusable(struct session *s) {
+    if (s->failed) {
+        return 0;
+    }
+    for (int d = 0; d < s->ndirs; d++) {
+        if (s->dirs[d].eof || s->dirs[d].len > 0 || s->dirs[d].zc != NULL) {
+            return 0;  // Late zerocopy completions would look like errors on an idle connection
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Relay data between the configured descriptors until EOF or timeout.
+ *
+ * Without -b the input descriptor is copied to the output descriptor. With -b
+ * the socket is copied to standard output and standard input to the socket.
+ * Sockets are non-blocking and each direction buffers what its destination
+ * did not accept yet. When -t or -T expires the session stops reading and
+ * drains its buffers for up to DRAIN_GRACE_MS before closing.
+ *
+ * @param descriptors Input and output descriptors.
+ * @param bidirectional Non-zero when -b was given.
+ * @return int 0 on a clean close, -1 on error.
+ */
+int relay(int *descriptors, int bidirectional) {
+    static struct session s;
+    struct evloop loop;
+
+    if (ev_init(&loop, 0) == -1) {
+        perror("Event loop setup failed");
+        return -1;
+    }
+
+    session_init(&s);
+    if (bidirectional) {
+        session_add_dir(&s, STDIN_FILENO, descriptors[1]);  // In the order of REC_DIR_IN and REC_DIR_OUT
+        session_add_dir(&s, descriptors[1], STDOUT_FILENO);
+    } else {
+        session_add_dir(&s, descriptors[0], descriptors[1]);
+    }
+
+    if (session_start(&loop, &s) == -1) {
+        ev_close(&loop);
+        return -1;
+    }
+    if (ev_run(&loop) == -1) {
+        perror("Event loop failed");
+        s.failed = 1;
+    }
+
+    session_stop(&loop, &s);
+    ev_close(&loop);
+    return s.failed ? -1 : 0;
+}
+
+/**
+ * @brief Wait until a non-blocking descriptor is ready again.
+ */
+static void await_fd(int fd, short events) {
+    struct pollfd pfd = {fd, events, 0};
+    poll(&pfd, 1, -1);
+}
+
+/**
+ * @brief Forward whatever is already queued on a socket, without waiting.
+ */
+static void forward_pending(int from, int to) {
+    char buffer[BUFFER_SIZE];
+    int pending;
+    while (ioctl(from, FIONREAD, &pending) == 0 && pending > 0) {
+        ssize_t n = recv(from, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n <= 0) {
+            return;
+        }
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = send(to, buffer + done, n - done, MSG_NOSIGNAL);
+            if (w == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    await_fd(to, POLLOUT);
+                    continue;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            done += w;
+        }
+    }
+}
+
+/**
+ * @brief Relay -i to -o inside the kernel through a BPF sockmap (-K).
+ *
+ * Both endpoints must be connected TCP sockets. Once the verdict program is
+ * installed mync only waits for the input to close (or -t / -T to expire),
+ * then lets the kernel flush what it redirected and reports the counters.
+ * Bytes that arrived before the switch are forwarded here first.
+ *
+ * @param descriptors Input and output descriptors.
+ * @return int 0 once the session ended, -1 if the kernel relay is not
+ *         available and the caller should relay in userspace.
+ */
+int KERNEL_RELAY(int *descriptors) {
+    struct sockmap_relay r;
+    int from = descriptors[0];
+    int to = descriptors[1];
+
+    if (capture != NULL) {
+        fprintf(stderr, "Kernel relay cannot capture, relaying in userspace\n");
+        return -1;
+    }
+    forward_pending(from, to);
+    if (sockmap_relay_start(&r, from, to) == -1) {
+        fprintf(stderr, "Kernel relay unavailable (%s), relaying in userspace\n", strerror(errno));
+        return -1;
+    }
+    printf("Relaying in the kernel\n");
+    fflush(stdout);
+
+    uint64_t chunks, bytes, seen = 0;
+    long long idle_since = monotonic_ms();
+    for (;;) {
+        struct pollfd pfds[2] = {{from, POLLRDHUP, 0}, {to, 0, 0}};
+        long long wait = session_remaining();
+        if (idle_timeout > 0 && (wait < 0 || wait > 1000)) {
+            wait = 1000;  // Idle time is measured by sampling the counters
+        }
+        int ret = poll(pfds, 2, (int)wait);
+        if (ret == -1 && errno != EINTR) {
+            perror("Poll failed");
+            break;
+        }
+        if (ret > 0) {
+            break;  // Input closed, or the output failed
+        }
+        if (session_remaining() == 0) {
+            fprintf(stderr, "Timeout expired\n");
+            break;
+        }
+        sockmap_relay_stats(&r, &chunks, &bytes);
+        if (bytes != seen) {
+            seen = bytes;
+            idle_since = monotonic_ms();
+        } else if (idle_timeout > 0 && monotonic_ms() - idle_since >= (long long)idle_timeout) {
+            fprintf(stderr, "Idle timeout expired\n");
+            break;
+        }
+    }
+
+    // Redirected chunks are sent from a kernel work queue: wait for them
+    long long deadline = monotonic_ms() + DRAIN_GRACE_MS;
+    while (!sockmap_relay_flushed(&r) && monotonic_ms() < deadline) {
+        usleep(1000);
+    }
+    sockmap_relay_stats(&r, &chunks, &bytes);
+    sockmap_relay_stop(&r);
+    shutdown(to, SHUT_WR);
+    fprintf(stderr, "Kernel relay moved %llu bytes in %llu chunks\n", (unsigned long long)bytes,
+            (unsigned long long)chunks);
+    return 0;
+}
+
+/**
+ * @brief A thread moving one direction between a descriptor and an SHM ring.
+ */
+struct shm_pump {
+    struct shm_endpoint *ep;
+    int fd;
+    int to_ring;  // fd -> ring, otherwise ring -> fd
+    pthread_t thread;
+};
+
+/**
+ * @brief Pump thread body.
+ *
+ * Data is read straight into the ring's free span and written straight
+ * from its readable span, so each chunk costs the descriptor's read(2) or
+ * write(2) and nothing for the shared-memory hop.
+ */
+static void *shm_pump_run(void *arg) {
+    struct shm_pump *pump = arg;
+    size_t len;
+
+    if (pump->to_ring) {
+        char *span;
+        while ((span = shm_write_span(pump->ep, &len)) != NULL) {
+            ssize_t n = read(pump->fd, span, len);
+            if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                await_fd(pump->fd, POLLIN);
+                continue;
+            }
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            shm_write_commit(pump->ep, n);
+        }
+        shm_close_write(pump->ep);
+        return NULL;
+    }
+
+    char *span;
+    while ((span = shm_read_span(pump->ep, &len)) != NULL) {
+        ssize_t n = write(pump->fd, span, len);
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            await_fd(pump->fd, POLLOUT);
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            break;
+        }
+        shm_read_release(pump->ep, n);
+    }
+    shm_close_read(pump->ep);
+    return NULL;
+}
+
+/**
+ * @brief Start a pump thread with every signal blocked.
+ *
+ * Signals stay with the main thread, so the reaper's signalfd still sees
+ * SIGCHLD and a closed descriptor yields EPIPE rather than SIGPIPE.
+ */
+static void shm_pump_start(struct shm_pump *pump, struct shm_endpoint *ep, int fd, int to_ring) {
+    sigset_t all, old;
+    pump->ep = ep;
+    pump->fd = fd;
+    pump->to_ring = to_ring;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&pump->thread, NULL, shm_pump_run, pump);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        errno = err;
+        perror("Thread creation failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Wait for pump threads, honouring the -t deadline.
+ *
+ * @return int 0 once every pump finished, -1 if the session timed out first.
+ */
+static int shm_pump_join(struct shm_pump *pumps, int npumps) {
+    for (int i = 0; i < npumps; i++) {
+        long long remaining = session_remaining();
+        if (remaining < 0) {
+            pthread_join(pumps[i].thread, NULL);
+            continue;
+        }
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += remaining / 1000;
+        until.tv_nsec += remaining % 1000 * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        if (pthread_timedjoin_np(pumps[i].thread, NULL, &until) != 0) {
+            fprintf(stderr, "Timeout expired\n");
+            return -1;  // Pumps blocked in read(2) end with the process
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Detach the channels of a finished session.
+ */
+static void shm_finish(struct shm_endpoint *in, struct shm_endpoint *out) {
+    if (in != NULL) {
+        shm_endpoint_close(in);
+    }
+    if (out != NULL && out != in) {
+        shm_endpoint_close(out);
+    }
+}
+
+/**
+ * @brief Relay between shared-memory endpoints and descriptors, without -e.
+ *
+ * Directions match relay(): with -b the channel is bridged to stdin and
+ * stdout, otherwise -i SHM feeds the output descriptor and -o SHM is fed by
+ * the input descriptor.
+ *
+ * @param in -i (or -b) channel, or NULL.
+ * @param out -o (or -b) channel, or NULL.
+ * @param descriptors Input and output descriptors.
+ * @param bidirectional Non-zero when -b was given.
+ * @return int 0 on a clean close, -1 on timeout.
+ */
+int shm_relay(struct shm_endpoint *in, struct shm_endpoint *out, int *descriptors, int bidirectional) {
+    struct shm_pump pumps[2];
+    int npumps = 0;
+
+    fflush(stdout);  // Setup messages precede relayed data
+    if (in != NULL) {
+        shm_pump_start(&pumps[npumps++], in, bidirectional ? STDOUT_FILENO : descriptors[1], 0);
+    }
+    if (out != NULL) {
+        shm_pump_start(&pumps[npumps++], out, bidirectional ? STDIN_FILENO : descriptors[0], 1);
+    }
+    if (shm_pump_join(pumps, npumps) == -1) {
+        return -1;  // Channels stay mapped for the pumps still running
+    }
+    shm_finish(in, out);
+    return 0;
+}
+
+/**
+ * @brief Run the -e child with shared-memory endpoints on its stdin/stdout.
+ *
+ * The child reads and writes pipes served by pump threads; endpoints that
+ * are not shared memory are passed to it directly as usual.
+ *
+ * @param command Command string executed.
+ * @param in -i (or -b) channel, or NULL.
+ * @param out -o (or -b) channel, or NULL.
+ * @param descriptors Input and output descriptors.
+ * @return int The child's exit code, 128 + signal if it was killed.
+ */
+int RUN_SHM(char *command, struct shm_endpoint *in, struct shm_endpoint *out, int *descriptors) {
+    struct shm_pump pumps[2];
+    int npumps = 0;
+    int in_fd = descriptors[0];
+    int out_fd = descriptors[1];
+    int fds[2];
+
+    if (in != NULL) {
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            perror("Pipe creation failed");
+            exit(EXIT_FAILURE);
+        }
+        in_fd = fds[0];
+        shm_pump_start(&pumps[npumps++], in, fds[1], 0);
+    }
+    if (out != NULL) {
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            perror("Pipe creation failed");
+            exit(EXIT_FAILURE);
+        }
+        out_fd = fds[1];
+        shm_pump_start(&pumps[npumps++], out, fds[0], 1);
+    }
+
+    int status = run_child(command, in_fd, out_fd);
+    int joined = 0;
+
+    // The child is gone: its output pipe reaches EOF once our end closes too.
+    // Flush that first, then stop waiting for input nobody will read.
+    if (out != NULL) {
+        close(out_fd);
+        joined |= shm_pump_join(&pumps[npumps - 1], 1);
+    }
+    if (in != NULL) {
+        close(in_fd);
+        shm_endpoint_shutdown(in);
+        joined |= shm_pump_join(&pumps[0], 1);
+    }
+    if (joined == 0) {
+        for (int i = 0; i < npumps; i++) {
+            close(pumps[i].fd);
+        }
+        shm_finish(in, out);
+    }
+    return status;
+}
+
+/**
+ * @brief Attach a SHM<name>[,spin] endpoint, waiting for its other side.
+ *
+ * @param value Option value after "SHM".
+ * @param ep Endpoint to open.
+ * @param descriptors Descriptors to close on failure.
+ */
+void SHM_ENDPOINT(char *value, struct shm_endpoint *ep, int *descriptors) {
+    int spin = 0;
+    char *comma = strchr(value, ',');
+    if (comma != NULL) {
+        if (strcmp(comma + 1, "spin") != 0) {
+            fprintf(stderr, "Invalid SHM option: %s\n", comma + 1);
+            close_descriptors(descriptors);
+            exit(EXIT_FAILURE);
+        }
+        *comma = '\0';
+        spin = 1;
+    }
+
+    printf("Waiting for the other side of shared memory channel %s\n", value);
+    fflush(stdout);
+    if (shm_endpoint_open(ep, value, spin, session_remaining()) == -1) {
+        if (errno == ETIMEDOUT) {
+            fprintf(stderr, "Timeout expired\n");
+        } else {
+            perror("Shared memory setup failed");
+        }
+        close_descriptors(descriptors);
+        exit(EXIT_FAILURE);
+    }
+    printf("Shared memory channel %s attached as side %d\n", value, ep->role);
+}
+
+/**
+ * @brief Parse a -w window size of the form COLSxROWS.
+ *
+ * @param value Option value.
+ * @param ws Window size to fill.
+ * @return int 0 on success, -1 if the value is malformed.
+ */
+int parse_winsize(const char *value, struct winsize *ws) {
+    unsigned cols, rows;
+    if (sscanf(value, "%ux%u", &cols, &rows) != 2 || cols == 0 || rows == 0) {
+        return -1;
+    }
+    memset(ws, 0, sizeof(*ws));
+    ws->ws_col = cols;
+    ws->ws_row = rows;
+    return 0;
+}
+
+/**
+ * @brief Open a pseudo-terminal pair configured for relaying.
+ *
+ * By default the line discipline stays canonical but echo and NL to CRNL
+ * translation are turned off, so the remote side sees exactly what the
+ * program prints. Raw mode disables all input and output processing.
+ *
+ * @param raw Non-zero for raw mode (-r).
+ * @param ws Window size, or NULL to keep the default.
+ * @param slave Receives the slave descriptor, which the child must inherit.
+ * @return int The non-blocking master descriptor, or -1 on failure.
+ */
+int open_pty(int raw, struct winsize *ws, int *slave) {
+    char slave_path[64];
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master == -1) {
+        return -1;
+    }
+    if (grantpt(master) == -1 || unlockpt(master) == -1 ||
+        ptsname_r(master, slave_path, sizeof(slave_path)) != 0) {
+        close(master);
+        return -1;
+    }
+
+    // Until the child holds the slave open, reading the master fails with EIO
+    *slave = open(slave_path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (*slave == -1) {
+        close(master);
+        return -1;
+    }
+
+    // Configure through the slave: termios changes on the master are not portable
+    struct termios tio;
+    if (tcgetattr(*slave, &tio) == 0) {
+        if (raw) {
+            cfmakeraw(&tio);
+        } else {
+            tio.c_lflag &= ~(ECHO | ECHOE | ECHOK | ECHONL);
+            tio.c_oflag &= ~ONLCR;
+        }
+        tcsetattr(*slave, TCSANOW, &tio);
+    }
+    if (ws != NULL) {
+        ioctl(master, TIOCSWINSZ, ws);
+    }
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    return master;
+}
+
+/**
+ * @brief Fork an -e child whose stdin and stdout mync relays itself.
+ *
+ * The child talks either to a pseudo-terminal slave (PTY mode) or to one end
+ * of a socketpair, and the other side is returned non-blocking to the caller.
+ *
+ * @param reaper Reaper that will report the child's exit.
+ * @param child Child record to register.
+ * @param args NULL terminated argument vector.
+ * @param use_pty Non-zero to run the child on a pseudo-terminal (-p).
+ * @param raw Non-zero for raw mode (-r).
+ * @param ws Window size, or NULL to keep the default.
+ * @return int The descriptor connected to the child's stdin and stdout.
+ */
+int spawn_relayed(struct reaper *reaper, struct child *child, char **args, int use_pty, int raw, struct winsize *ws) {
+    int parent_fd, child_fd;
+
+    if (use_pty) {
+        parent_fd = open_pty(raw, ws, &child_fd);
+        if (parent_fd == -1) {
+            perror("PTY setup failed");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1) {
+            perror("Socketpair failed");
+            exit(EXIT_FAILURE);
+        }
+        parent_fd = pair[0];
+        child_fd = pair[1];
+        set_nonblocking_socket(parent_fd);
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Fork failed");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        reaper_child_setup(reaper);
+        if (use_pty) {
+            // New session so the slave becomes the controlling terminal
+            setsid();
+            if (ioctl(child_fd, TIOCSCTTY, 0) == -1) {
+                perror("PTY slave setup failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        dup2(child_fd, STDIN_FILENO);  // The CLOEXEC original closes on exec
+        dup2(child_fd, STDOUT_FILENO);
+        execvp(args[0], args);  // Execute the command in the child process
+        perror("Execution failed");  // If execvp returns, it must have failed
+        exit(EXIT_FAILURE);
+    }
+    reaper_adopt(reaper, child, pid);
+    close(child_fd);  // The child's exit now ends the stream
+    return parent_fd;
+}
+
+/**
+ * @brief Wait for a relayed child after its stream was closed.
+ *
+ * Closing a PTY master hangs up the terminal and closing the socketpair gives
+ * the child EOF; a child still alive after DRAIN_GRACE_MS is killed.
+ *
+ * @param loop Event loop the reaper is registered with.
+ * @param watch Watch of the child.
+ */
+static void finish_child(struct evloop *loop, struct child_watch *watch) {
+    if (watch->child.pid != 0) {
+        watch->stop_on_exit = 1;
+        ev_timer_start(loop, &watch->kill_timer, DRAIN_GRACE_MS, on_child_kill, watch);
+        ev_run(loop);
+    }
+}
+
+/**
+ * @brief Execute a command and relay its standard streams through mync.
+ *
+ * Used when mync has to see the child's traffic: in PTY mode (-p) the child
+ * runs on a pseudo-terminal, so stdio line-buffers its output and prompts
+ * reach the peer immediately without modifying the program; with capture
+ * (-c) the child's traffic is recorded. Input comes from descriptors[0] and
+ * the program's output goes to descriptors[1]. The end of the input reaches
+ * the child as EOF, and the session lasts until the child ends its output.
+ *
+ * @param args_as_string Command string to be executed.
+ * @param descriptors Input and output descriptors.
+ * @param use_pty Non-zero to run the child on a pseudo-terminal (-p).
+ * @param raw Non-zero for raw mode (-r).
+ * @param ws Window size, or NULL to keep the default.
+ * @return int The child's exit code, 128 + signal if it was killed.
+ */
+int RUN_RELAYED(char *args_as_string, int *descriptors, int use_pty, int raw, struct winsize *ws) {
+    char **args = split_command(args_as_string);
+    static struct session s;
+    struct child_watch watch = {.child = {.on_exit = on_child_exit, .arg = &watch}};
+    struct evloop loop;
+    struct reaper reaper;
+
+    if (ev_init(&loop, 0) == -1 || reaper_init(&reaper, &loop) == -1) {
+        perror("Event loop setup failed");
+        exit(EXIT_FAILURE);
+    }
+    reaper.child_cpus = child_cpus;
+    ev_timer_init(&watch.session_timer);
+    ev_timer_init(&watch.kill_timer);
+
+    int child_fd = spawn_relayed(&reaper, &watch.child, args, use_pty, raw, ws);
+
+    session_init(&s);
+    session_add_dir(&s, descriptors[0], child_fd);
+    session_add_dir(&s, child_fd, descriptors[1]);
+    s.dirs[0].half_close = 1;  // The end of input is passed on; the child's exit ends the session
+    if (session_start(&loop, &s) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    ev_run(&loop);
+    session_stop(&loop, &s);
+
+    close(child_fd);
+    finish_child(&loop, &watch);
+
+    reaper_close(&reaper, &loop);
+    ev_close(&loop);
+    free(args);
+
+    report_child_status(watch.status);
+    return exit_code(watch.status);
+}
+
+/**
+ * @brief State of a capture file being played back into a target.
+ */
+struct replay {
+    struct rec_reader reader;
+    double speed;               // Playback speed factor, 0 for as fast as possible
+    int fd;                     // Receives the recorded input chunks
+    int readable;               // fd also returns output that is copied to stdout
+    struct ev_io io;
+    int tfd;                    // High resolution timerfd pacing the chunks
+    struct ev_io tio;
+    uint64_t first_ts;          // Timestamp of the first recorded input chunk
+    uint64_t start_ns;          // When playback started
+    const char *chunk;          // Chunk being written, NULL while waiting
+    size_t left;
+    int pending;                // Chunk read ahead and waiting for its due time
+    struct rec_header pending_hdr;
+    const char *pending_payload;
+    int sent_all;
+    unsigned long chunks;
+    unsigned long long bytes;
+    uint64_t max_lag_ns;        // Worst delay between a chunk's due time and its send
+    uint64_t due_ns;
+    int failed;
+};
+
+/**
+ * @brief Update the replay's epoll interest after a state change.
+ */
+static void replay_update(struct evloop *loop, struct replay *r) {
+    uint32_t events = 0;
+    if (r->readable) {
+        events |= EPOLLIN;
+    }
+    if (r->chunk != NULL) {
+        events |= EPOLLOUT;
+    }
+    ev_io_mod(loop, &r->io, events);
+}
+
+/**
+ * @brief Write as much of the current chunk as the target accepts.
+ *
+ * @return int 0 when the chunk was fully written or would block, -1 on error.
+ */
+static int replay_write(struct replay *r) {
+    while (r->left > 0) {
+        ssize_t n = write(r->fd, r->chunk, r->left);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            perror("Write failed");
+            return -1;
+        }
+        r->chunk += n;
+        r->left -= n;
+    }
+    r->chunk = NULL;
+    return 0;
+}
+
+/**
+ * @brief Start sending the next input chunk, now or when it is due.
+ *
+ * Output chunks of the capture are skipped; they are what the target is
+ * expected to produce. After the last input chunk the target is sent EOF
+ * with send_eof(), so a PTY child sees it as well.
+ */
+static void replay_next(struct evloop *loop, struct replay *r) {
+    struct rec_header hdr;
+    const char *payload;
+
+    while (r->chunk == NULL) {
+        int ret = 1;
+        if (r->pending) {
+            hdr = r->pending_hdr;
+            payload = r->pending_payload;
+            r->pending = 0;
+        } else {
+            ret = rec_reader_next(&r->reader, &hdr, &payload);
+        }
+        if (ret == -1) {
+            fprintf(stderr, "Capture file is truncated\n");
+        }
+        if (ret != 1) {
+            r->sent_all = 1;
+            send_eof(r->fd);
+            if (!r->readable) {
+                ev_stop(loop);
+            }
+            replay_update(loop, r);
+            return;
+        }
+        if (hdr.dir != REC_DIR_IN || hdr.len == 0) {
+            continue;
+        }
+
+        if (r->first_ts == 0) {
+            r->first_ts = hdr.ts_ns;
+        }
+        r->due_ns = r->start_ns;
+        if (r->speed > 0) {
+            r->due_ns += (uint64_t)((hdr.ts_ns - r->first_ts) / r->speed);
+        }
+
+        uint64_t now = rec_now_ns();
+        if (r->due_ns > now) {
+            // Not due yet: keep the chunk aside and arm the pacing timer
+            struct itimerspec spec = {0};
+            spec.it_value.tv_sec = r->due_ns / 1000000000ULL;
+            spec.it_value.tv_nsec = r->due_ns % 1000000000ULL;
+            r->pending = 1;
+            r->pending_hdr = hdr;
+            r->pending_payload = payload;
+            timerfd_settime(r->tfd, TFD_TIMER_ABSTIME, &spec, NULL);
+            replay_update(loop, r);  // No EPOLLOUT until then, or the loop would spin
+            return;
+        }
+
+        if (now - r->due_ns > r->max_lag_ns) {
+            r->max_lag_ns = now - r->due_ns;
+        }
+        r->chunk = payload;
+        r->left = hdr.len;
+        r->chunks++;
+        r->bytes += hdr.len;
+        if (capture != NULL) {
+            recorder_write(capture, REC_DIR_IN, payload, hdr.len);
+        }
+        if (replay_write(r) == -1) {
+            r->failed = 1;
+            ev_stop(loop);
+            return;
+        }
+    }
+    replay_update(loop, r);
+}
+
+/**
+ * @brief Pacing timer callback: the next chunk is due.
+ */
+static void on_replay_timer(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct replay *r = io->arg;
+    uint64_t expirations;
+    if (read(io->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    replay_next(loop, r);
+}
+
+/**
+ * @brief Target readiness: finish a pending chunk and copy output to stdout.
+ */
+static void on_replay_io(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct replay *r = io->arg;
+
+    if (r->chunk != NULL && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        if (replay_write(r) == -1) {
+            r->failed = 1;
+            ev_stop(loop);
+            return;
+        }
+        if (r->chunk == NULL) {
+            replay_next(loop, r);
+        }
+    }
+
+    if (r->readable && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        char buffer[BUFFER_SIZE];
+        ssize_t n = read(r->fd, buffer, sizeof(buffer));
+        if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != EIO) {
+            perror("Read failed");
+            r->failed = 1;
+            ev_stop(loop);
+            return;
+        }
+        if (n == 0 || (n == -1 && errno == EIO)) {
+            ev_stop(loop);  // The target closed its output
+            return;
+        }
+        if (n > 0) {
+            if (capture != NULL) {
+                recorder_write(capture, REC_DIR_OUT, buffer, n);
+            }
+            if (write(STDOUT_FILENO, buffer, n) == -1) {
+                perror("Write failed");
+            }
+        }
+    }
+}
+
+/**
+ * @brief Parse a -P value of the form FILE[,SPEED].
+ *
+ * SPEED is a factor applied to the recorded timing (2 plays twice as fast)
+ * or "max" to send every chunk as soon as the target accepts it.
+ *
+ * @param value Option value, the comma is replaced by a terminator.
+ * @param speed Receives the speed factor, 0 for "max".
+ * @return int 0 on success, -1 if the speed is malformed.
+ */
+int parse_replay(char *value, double *speed) {
+    *speed = 1.0;
+    char *comma = strrchr(value, ',');
+    if (comma == NULL) {
+        return 0;
+    }
+    *comma = '\0';
+    if (strcmp(comma + 1, "max") == 0) {
+        *speed = 0;
+        return 0;
+    }
+    *speed = atof(comma + 1);
+    return *speed > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Play the input side of a capture into an -e child or output endpoint.
+ *
+ * Input chunks are written at their recorded offsets scaled by the speed
+ * factor; whatever the target answers is copied to standard output (and to
+ * a new capture with -c, so the two runs can be compared). The worst pacing
+ * lag is reported so latency regressions can be told apart from replay noise.
+ *
+ * @param path Capture file.
+ * @param speed Speed factor, 0 for as fast as possible.
+ * @param command -e command string, or NULL to replay into descriptors[1].
+ * @param descriptors Input and output descriptors.
+ * @param use_pty Non-zero to run the child on a pseudo-terminal (-p).
+ * @param raw Non-zero for raw mode (-r).
+ * @param ws Window size, or NULL to keep the default.
+ * @return int The child's exit code, or 0/1 for success/failure without -e.
+ */
+int REPLAY(const char *path, double speed, char *command, int *descriptors, int use_pty, int raw, struct winsize *ws) {
+    static struct replay r;
+    struct child_watch watch = {.child = {.on_exit = on_child_exit, .arg = &watch}};
+    struct evloop loop;
+    struct reaper reaper;
+    char **args = NULL;
+
+    memset(&r, 0, sizeof(r));
+    if (rec_reader_open(&r.reader, path) == -1) {
+        perror("Open capture failed");
+        exit(EXIT_FAILURE);
+    }
+    r.speed = speed;
+    if (ev_init(&loop, 0) == -1 || reaper_init(&reaper, &loop) == -1) {
+        perror("Event loop setup failed");
+        exit(EXIT_FAILURE);
+    }
+    reaper.child_cpus = child_cpus;
+    ev_timer_init(&watch.session_timer);
+    ev_timer_init(&watch.kill_timer);
+
+    if (command != NULL) {
+        args = split_command(command);
+        r.fd = spawn_relayed(&reaper, &watch.child, args, use_pty, raw, ws);
+        r.readable = 1;
+    } else {
+        struct stat st;
+        r.fd = descriptors[1];
+        r.readable = fstat(r.fd, &st) == 0 && S_ISSOCK(st.st_mode);
+        set_nonblocking_socket(r.fd);
+    }
+
+    r.tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (r.tfd == -1 ||
+        ev_io_add(&loop, &r.tio, r.tfd, EPOLLIN, on_replay_timer, &r) == -1 ||
+        ev_io_add(&loop, &r.io, r.fd, 0, on_replay_io, &r) == -1) {
+        perror("Event registration failed");
+        exit(EXIT_FAILURE);
+    }
+
+    r.start_ns = rec_now_ns();
+    replay_next(&loop, &r);
+    if (!loop.stop) {
+        ev_run(&loop);
+    }
+    uint64_t elapsed = rec_now_ns() - r.start_ns;
+
+    fprintf(stderr, "Replayed %lu chunks (%llu bytes) in %.3f ms, max lag %.1f us\n",
+            r.chunks, r.bytes, elapsed / 1e6, r.max_lag_ns / 1e3);
+
+    ev_io_del(&loop, &r.io);
+    ev_io_del(&loop, &r.tio);
+    close(r.tfd);
+    rec_reader_close(&r.reader);
+
+    int status = r.failed ? EXIT_FAILURE : 0;
+    if (command != NULL) {
+        close(r.fd);
+        finish_child(&loop, &watch);
+        report_child_status(watch.status);
+        status = exit_code(watch.status);
+        free(args);
+    }
+    reaper_close(&reaper, &loop);
+    ev_close(&loop);
+    return status;
+}
+
+/**
+ * @brief End callback of a single -E session.
+ */
+static void on_plugin_end(struct evloop *loop, struct mync_session *session) {
+    ev_stop(loop);
+}
+
+/**
+ * @brief -t expiry of a single -E session.
+ */
+static void on_plugin_timeout(struct evloop *loop, struct ev_timer *timer) {
+    struct mync_session *session = timer->arg;
+    fprintf(stderr, "Timeout expired\n");
+    plugin_session_stop(session);
+    ev_stop(loop);
+}
+
+/**
+ * @brief Serve one connection (or -i/-o pair) with the -E plugin, in-process.
+ *
+ * The plugin reads what the -e child would have read on stdin and its output
+ * goes where the child's stdout would have gone, without fork, exec or a
+ * relay hop in between.
+ *
+ * @param descriptors Input and output descriptors.
+ * @return int 0 when the plugin ended the session cleanly, 1 otherwise.
+ */
+int RUN_PLUGIN(int *descriptors) {
+    static struct mync_session session;
+    struct ev_timer timer;
+    struct evloop loop;
+
+    if (ev_init(&loop, 0) == -1) {
+        perror("Event loop setup failed");
+        exit(EXIT_FAILURE);
+    }
+    ev_timer_init(&timer);
+
+    session.capture = capture;
+    if (plugin_session_start(&loop, &session, handler, descriptors[0], descriptors[1], on_plugin_end, NULL) == -1) {
+        ev_close(&loop);
+        return session.failed || session.state == NULL ? 1 : 0;
+    }
+    long long remaining = session_remaining();
+    if (remaining >= 0) {
+        ev_timer_start(&loop, &timer, remaining, on_plugin_timeout, &session);
+    }
+    if (ev_run(&loop) == -1) {
+        perror("Event loop failed");
+        session.failed = 1;
+    }
+    ev_timer_stop(&loop, &timer);
+    plugin_session_stop(&session);
+    ev_close(&loop);
+    return session.failed ? 1 : 0;
+}
+
+/**
+ * @brief Number of live sessions of one client address, for -M.
+ */
+struct ip_count {
+    in_addr_t addr;
+    int sessions;
+    struct ip_count *next;
+};
+
+/**
+ * @brief A client connection of the TCPMUXS server and the child serving it.
+ */
+struct mux_client {
+    int id;
+    int fd;
+    struct ip_count *ip;  // Per-IP admission counter of the client's address
+    struct child child;
+    int running;
+    unsigned restarts;
+    long long started;
+    struct ev_timer restart_timer;
+    struct mync_session session;  // -E session, unused with -e children
+    in_addr_t peer;               // Client address, hashed by the balancer
+    struct backend *backend;      // -U backend connected or being connected to
+    int backend_fd;
+    uint64_t tried;               // Backends tried for this client, see balancer_pick()
+    int connecting;
+    struct ev_io connect_io;
+    int relaying;
+    struct session relay;         // -U proxy session between the client and its backend
+    struct mux_server *server;
+    struct mux_client *next;
+    struct mux_client *prev;
+};
+
+/**
+ * @brief A TCPMUXS server: one -e child (or -E session) per accepted client, all supervised by one loop.
+ */
+struct mux_server {
+    struct evloop *loop;
+    struct reaper *reaper;
+    struct balancer *balancer;  // -U backends, NULL to serve clients with -e or -E
+    int listen_fd;
+    struct ev_io listen_io;
+    char **args;
+    int in_fd;    // Child stdin, -1 to use the client socket
+    int out_fd;   // Child stdout, -1 to use the client socket
+    struct mux_client clients;  // Sentinel of the client list
+    int nclients;
+    int next_id;
+    int closing;
+    struct ev_io drain_io;      // Readable once the listener was handed to a successor
+    struct ev_timer session_timer;
+    struct ev_timer kill_timer;
+    struct ip_count *ips[IP_BUCKETS];
+    int spare_fd;               // Released to shed connections when out of descriptors
+    unsigned long rejected;
+    void (*on_drained)(struct mux_server *server);  // Closing and empty, NULL to stop the loop
+    void *arg;
+};
+
+/**
+ * @brief The server stopped accepting and its last client is gone.
+ */
+static void mux_drained(struct mux_server *server) {
+    if (server->on_drained != NULL) {
+        server->on_drained(server);
+    } else {
+        ev_stop(server->loop);
+    }
+}
+
+/**
+ * @brief Find (or create) the admission counter of a client address.
+ *
+ * @return struct ip_count* The counter, or NULL if allocation failed.
+ */
+static struct ip_count *ip_lookup(struct mux_server *server, in_addr_t addr) {
+    struct ip_count **bucket = &server->ips[(addr * 2654435761u) % IP_BUCKETS];
+    for (struct ip_count *ip = *bucket; ip != NULL; ip = ip->next) {
+        if (ip->addr == addr) {
+            return ip;
+        }
+    }
+    struct ip_count *ip = calloc(1, sizeof(*ip));
+    if (ip != NULL) {
+        ip->addr = addr;
+        ip->next = *bucket;
+        *bucket = ip;
+    }
+    return ip;
+}
+
+/**
+ * @brief Drop one session from an address's counter, freeing it at zero.
+ */
+static void ip_release(struct mux_server *server, struct ip_count *ip) {
+    if (ip == NULL || --ip->sessions > 0) {
+        return;
+    }
+    for (struct ip_count **p = &server->ips[(ip->addr * 2654435761u) % IP_BUCKETS]; *p != NULL; p = &(*p)->next) {
+        if (*p == ip) {
+            *p = ip->next;
+            free(ip);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Check whether the peer of a connected socket has closed it.
+ *
+ * @param fd Connected socket.
+ * @return int Non-zero if an orderly shutdown or an error is pending.
+ */
+static int peer_closed(int fd) {
+    char byte;
+    ssize_t n = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+/**
+ * @brief Close a client connection and forget it.
+ */
+static void mux_client_free(struct mux_server *server, struct mux_client *c) {
+    ev_timer_stop(server->loop, &c->restart_timer);
+    if (handler != NULL) {
+        plugin_session_stop(&c->session);
+    }
+    if (c->connecting) {
+        ev_io_del(server->loop, &c->connect_io);
+    }
+    if (c->relaying) {
+        session_stop(server->loop, &c->relay);
+        c->backend->active--;
+    }
+    if (c->backend_fd != -1) {
+        close(c->backend_fd);
+    }
+    ip_release(server, c->ip);
+    shutdown(c->fd, SHUT_WR);
+    close(c->fd);
+    c->prev->next = c->next;
+    c->next->prev = c->prev;
+    free(c);
+    server->nclients--;
+
+    if (server->closing && server->nclients == 0) {
+        mux_drained(server);
+    }
+}
+
+/**
+ * @brief Start (or restart) the child serving a client.
+ *
+ * @return int 0 on success, -1 if fork failed.
+ */
+static int mux_client_spawn(struct mux_server *server, struct mux_client *c) {
+    int in_fd = server->in_fd == -1 ? c->fd : server->in_fd;
+    int out_fd = server->out_fd == -1 ? c->fd : server->out_fd;
+    if (reaper_spawn(server->reaper, &c->child, server->args, in_fd, out_fd) < 0) {
+        perror("Fork failed");
+        return -1;
+    }
+    c->running = 1;
+    c->started = monotonic_ms();
+    return 0;
+}
+
+/**
+ * @brief Restart timer callback of a crashed client's child.
+ */
+static void on_mux_restart(struct evloop *loop, struct ev_timer *timer) {
+    struct mux_client *c = timer->arg;
+    if (mux_client_spawn(c->server, c) == -1) {
+        mux_client_free(c->server, c);
+    }
+}
+
+/**
+ * @brief Reaper callback: restart a crashed child or report its status and close.
+ *
+ * A child crashed when it was killed by a signal or exited non-zero. It is
+ * restarted on the same connection after an exponential backoff, up to -R
+ * times, as long as the client is still connected. Otherwise the exit code is
+ * sent as a final "EXIT <code>" frame when -S is set, and the connection closes.
+ */
+static void on_mux_child_exit(struct evloop *loop, struct child *child, int status) {
+    struct mux_client *c = child->arg;
+    struct mux_server *server = c->server;
+    int code = exit_code(status);
+    c->running = 0;
+
+    if (!server->closing && code != 0 && !peer_closed(c->fd)) {
+        if (monotonic_ms() - c->started > RESTART_RESET_MS) {
+            c->restarts = 0;
+        }
+        if (c->restarts < max_restarts) {
+            unsigned long backoff = RESTART_BACKOFF_MS << (c->restarts < 6 ? c->restarts : 6);
+            if (backoff > RESTART_BACKOFF_MAX_MS) {
+                backoff = RESTART_BACKOFF_MAX_MS;
+            }
+            c->restarts++;
+            fprintf(stderr, "Session %d: child crashed with status %d, restart %u in %lu ms\n",
+                    c->id, code, c->restarts, backoff);
+            ev_timer_start(loop, &c->restart_timer, backoff, on_mux_restart, c);
+            return;
+        }
+    }
+
+    fprintf(stderr, "Session %d: child exited with status %d\n", c->id, code);
+    if (status_frames) {
+        char frame[32];
+        int len = snprintf(frame, sizeof(frame), "EXIT %d\n", code);
+        send(c->fd, frame, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    mux_client_free(server, c);
+}
+
+/**
+ * @brief End callback of a client's -E session: report it and close.
+ */
+static void on_mux_session_end(struct evloop *loop, struct mync_session *session) {
+    struct mux_client *c = session->arg;
+    int code = session->failed ? 1 : 0;
+
+    fprintf(stderr, "Session %d: plugin session ended with status %d\n", c->id, code);
+    if (status_frames) {
+        char frame[32];
+        int len = snprintf(frame, sizeof(frame), "EXIT %d\n", code);
+        send(c->fd, frame, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    mux_client_free(c->server, c);
+}
+
+/**
+ * @brief End callback of a client's -U proxy session.
+ */
+static void on_mux_relay_end(struct evloop *loop, struct session *s) {
+    struct mux_client *c = s->arg;
+    fprintf(stderr, "Session %d: backend %s session ended%s\n", c->id, c->backend->name,
+            s->failed ? " with an error" : "");
+    // The backend never learns the client left, so only a stateless protocol may hand it to the next one
+    if (c->backend->reuse && c->backend->pool.max_idle > 0 && session_reusable(s)) {
+        session_detach(loop, s, c->backend_fd);
+        pool_return(&c->backend->pool, c->backend_fd);
+        c->backend_fd = -1;
+    }
+    mux_client_free(c->server, c);
+}
+
+/**
+ * @brief Start relaying between a client and the backend it connected to.
+ */
+static void mux_client_relay(struct mux_server *server, struct mux_client *c) {
+    session_init(&c->relay);
+    session_add_dir(&c->relay, c->fd, c->backend_fd);
+    session_add_dir(&c->relay, c->backend_fd, c->fd);
+    c->relay.dirs[0].half_close = c->relay.dirs[1].half_close = 1;
+    c->relay.on_end = on_mux_relay_end;
+    c->relay.arg = c;
+
+    c->relaying = 1;
+    c->backend->active++;
+    c->backend->sessions++;
+    fprintf(stderr, "Session %d: relaying to backend %s\n", c->id, c->backend->name);
+    if (session_start(server->loop, &c->relay) == -1) {
+        mux_client_free(server, c);
+    }
+}
+
+static void mux_client_connect(struct mux_server *server, struct mux_client *c);
+
+/**
+ * @brief Completion of a non-blocking connect to a backend.
+ */
+static void on_backend_connect(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct mux_client *c = io->arg;
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    ev_io_del(loop, &c->connect_io);
+    c->connecting = 0;
+    getsockopt(c->backend_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err == 0) {
+        mux_client_relay(c->server, c);
+        return;
+    }
+    backend_failed(c->backend, err);
+    close(c->backend_fd);
+    c->backend_fd = -1;
+    mux_client_connect(c->server, c);  // Fail over to the next backend
+}
+
+/**
+ * @brief Connect a client to a backend chosen by the balancer.
+ *
+ * A warm connection from the backend's pool is used when one is idle.
+ * Otherwise the connect is non-blocking and completes in
+ * on_backend_connect(). A backend that refuses is marked down and the next
+ * candidate is tried at once, each backend at most once per client.
+ */
+static void mux_client_connect(struct mux_server *server, struct mux_client *c) {
+    for (;;) {
+        struct backend *be = balancer_pick(server->balancer, c->peer, c->tried);
+        if (be == NULL) {
+            break;
+        }
+        c->backend = be;
+        c->tried |= 1ULL << (be - server->balancer->backends);
+
+        int fd = pool_lease(&be->pool);
+        if (fd != -1) {
+            c->backend_fd = fd;
+            mux_client_relay(server, c);
+            return;
+        }
+        fd = socket(be->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            perror("Socket creation failed");
+            break;
+        }
+        c->backend_fd = fd;
+        if (connect(fd, (struct sockaddr *)&be->addr, be->addrlen) == 0) {
+            mux_client_relay(server, c);
+            return;
+        }
+        if (errno == EINPROGRESS) {
+            if (ev_io_add(server->loop, &c->connect_io, fd, EPOLLOUT, on_backend_connect, c) == -1) {
+                perror("Event registration failed");
+                break;
+            }
+            c->connecting = 1;
+            return;
+        }
+        if (errno != EAGAIN) {  // A Unix listener with a full backlog is busy, not down
+            backend_failed(be, errno);
+        }
+        close(fd);
+        c->backend_fd = -1;
+    }
+    fprintf(stderr, "Session %d: no backend available\n", c->id);
+    mux_client_free(server, c);
+}
+
+/**
+ * @brief Turn a connection away without ever blocking the loop.
+ *
+ * The socket is non-blocking, so the BUSY notice is best effort, and the
+ * zero linger makes close() reset the connection instead of lingering.
+ */
+static void mux_reject(struct mux_server *server, int fd) {
+    struct linger linger = {1, 0};
+    send(fd, "BUSY\n", 5, MSG_NOSIGNAL | MSG_DONTWAIT);
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    close(fd);
+    server->rejected++;
+}
+
+/**
+ * @brief Admit one accepted connection and start its child or -E session.
+ */
+static void mux_admit(struct mux_server *server, int fd, struct sockaddr_in *addr) {
+    struct ip_count *ip = NULL;
+
+    if (max_sessions > 0 && server->nclients >= max_sessions) {
+        mux_reject(server, fd);
+        return;
+    }
+    if (max_per_ip > 0) {
+        ip = ip_lookup(server, addr->sin_addr.s_addr);
+        if (ip == NULL || ip->sessions >= max_per_ip) {
+            mux_reject(server, fd);
+            return;
+        }
+    }
+
+    struct mux_client *c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        perror("Allocation failed");
+        mux_reject(server, fd);
+        return;
+    }
+    if (ip != NULL) {
+        ip->sessions++;
+        c->ip = ip;
+    }
+
+    // The child reads the socket as its stdin, which must block
+    if (handler == NULL && server->balancer == NULL) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    }
+
+    c->id = ++server->next_id;
+    c->fd = fd;
+    c->backend_fd = -1;
+    c->peer = addr->sin_addr.s_addr;
+    c->server = server;
+    c->child.on_exit = on_mux_child_exit;
+    c->child.arg = c;
+    ev_timer_init(&c->restart_timer);
+
+    c->next = &server->clients;
+    c->prev = server->clients.prev;
+    server->clients.prev->next = c;
+    server->clients.prev = c;
+    server->nclients++;
+
+    fprintf(stderr, "Session %d: client %s connected\n", c->id, inet_ntoa(addr->sin_addr));
+    if (server->balancer != NULL) {
+        mux_client_connect(server, c);
+    } else if (handler != NULL) {
+        if (plugin_session_start(server->loop, &c->session, handler, fd, fd, on_mux_session_end, c) == -1) {
+            mux_client_free(server, c);  // Refused, or over within init()
+        }
+    } else if (mux_client_spawn(server, c) == -1) {
+        mux_client_free(server, c);
+    }
+}
+
+/**
+ * @brief Accept every pending client on the TCPMUXS listener.
+ *
+ * Connections are accepted in a loop until EAGAIN (bounded by
+ * ACCEPT_BATCH_MAX), so a connect storm drains the accept queue in one
+ * wakeup. When the process runs out of descriptors the spare descriptor is
+ * released to accept and reset one connection, instead of leaving the
+ * listener permanently readable.
+ */
+static void on_mux_accept(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct mux_server *server = io->arg;
+
+    for (int i = 0; i < ACCEPT_BATCH_MAX && !server->closing; i++) {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        int fd = accept4(server->listen_fd, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd >= 0) {
+            mux_admit(server, fd, &addr);
+            continue;
+        }
+
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+        if ((errno == EMFILE || errno == ENFILE) && server->spare_fd != -1) {
+            close(server->spare_fd);
+            fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0) {
+                mux_reject(server, fd);
+            }
+            server->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("Accept failed");
+        }
+        return;
+    }
+}
+
+/**
+ * @brief SIGKILL children that outlived the shutdown grace period.
+ */
+static void on_mux_kill(struct evloop *loop, struct ev_timer *timer) {
+    struct mux_server *server = timer->arg;
+    for (struct mux_client *c = server->clients.next; c != &server->clients; c = c->next) {
+        if (c->running) {
+            kill(c->child.pid, SIGKILL);
+        }
+    }
+}
+
+/**
+ * @brief Stop accepting clients; the server stops once the last one is gone.
+ *
+ * @param server TCPMUXS server.
+ */
+static void mux_stop_accepting(struct mux_server *server) {
+    server->closing = 1;
+    if (server->listen_fd != -1) {
+        ev_io_del(server->loop, &server->listen_io);
+        close(server->listen_fd);
+        server->listen_fd = -1;
+    }
+}
+
+/**
+ * @brief The listener was handed off: let the sessions finish undisturbed.
+ */
+static void on_mux_drain(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct mux_server *server = io->arg;
+    (void)events;
+
+    ev_io_del(loop, io);
+    close(io->fd);
+    printf("Listener handed off, draining %d sessions\n", server->nclients);
+    fflush(stdout);
+    mux_stop_accepting(server);
+    if (server->nclients == 0) {
+        mux_drained(server);
+    }
+}
+
+/**
+ * @brief Stop accepting, terminate every child and wait for them.
+ *
+ * @param server TCPMUXS server.
+ */
+static void mux_shutdown(struct mux_server *server) {
+    struct evloop *loop = server->loop;
+
+    mux_stop_accepting(server);
+    server->nclients++;  // Keeps the server from being drained while its clients are let go
+
+    struct mux_client *c = server->clients.next;
+    while (c != &server->clients) {
+        struct mux_client *next = c->next;
+        if (c->running) {
+            kill(c->child.pid, SIGTERM);
+        } else if (c->relaying) {
+            session_drain(loop, &c->relay);  // Flush what is in flight, then close
+            session_ended(loop, &c->relay);
+        } else {
+            mux_client_free(server, c);  // Waiting for a restart, or an -E session
+        }
+        c = next;
+    }
+
+    if (--server->nclients == 0) {
+        mux_drained(server);
+    } else {
+        ev_timer_start(loop, &server->kill_timer, DRAIN_GRACE_MS, on_mux_kill, server);
+    }
+}
+
+/**
+ * @brief -t expiry: shut the server down.
+ */
+static void on_mux_timeout(struct evloop *loop, struct ev_timer *timer) {
+    struct mux_server *server = timer->arg;
+    fprintf(stderr, "Timeout expired, closing %d sessions\n", server->nclients);
+    mux_shutdown(server);
+}
+
+/**
+ * @brief Start a TCPMUXS server on a loop.
+ *
+ * @param server Server to initialize, which must not move afterwards.
+ * @param loop Event loop to serve clients on.
+ * @param reaper Reaper of the loop, supervising -e children.
+ * @param listen_fd Non-blocking listening socket, owned by the server from now on.
+ * @param command Command string executed for every client, NULL with -E or -U.
+ * @param backends Balancer to proxy every client with, NULL without -U.
+ * @return int 0 on success, -1 on failure.
+ */
+static int mux_server_start(struct mux_server *server, struct evloop *loop, struct reaper *reaper, int listen_fd,
+                            char *command, struct balancer *backends) {
+    memset(server, 0, sizeof(*server));
+    server->loop = loop;
+    server->reaper = reaper;
+    server->balancer = backends;
+    server->args = command != NULL ? split_command(command) : NULL;
+    server->in_fd = server->out_fd = -1;
+    server->clients.next = server->clients.prev = &server->clients;
+    ev_timer_init(&server->session_timer);
+    ev_timer_init(&server->kill_timer);
+
+    if (backends != NULL) {
+        balancer_start(backends, loop, health_interval);
+    }
+    server->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    server->listen_fd = listen_fd;
+    if (ev_io_add(loop, &server->listen_io, listen_fd, EPOLLIN, on_mux_accept, server) == -1) {
+        perror("Event registration failed");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Release a server that has no clients left.
+ *
+ * @param server Server to close.
+ */
+static void mux_server_close(struct mux_server *server) {
+    mux_stop_accepting(server);
+    ev_timer_stop(server->loop, &server->session_timer);
+    ev_timer_stop(server->loop, &server->kill_timer);
+    if (server->rejected > 0) {
+        fprintf(stderr, "Rejected %lu connections\n", server->rejected);
+    }
+    if (server->balancer != NULL) {
+        for (int i = 0; i < server->balancer->nbackends; i++) {
+            struct backend *be = &server->balancer->backends[i];
+            if (be->pool.max_idle > 0) {
+                fprintf(stderr, "Backend %s: %lu sessions, %lu on warm connections, %lu connections reused\n",
+                        be->name, be->sessions, be->pool.hits, be->pool.reused);
+            }
+        }
+        balancer_close(server->balancer);
+    }
+    if (server->spare_fd != -1) {
+        close(server->spare_fd);
+    }
+    free(server->args);
+}
+
+/**
+ * @brief Serve many clients on one port, each with its own -e child.
+ *
+ * Children are reaped through a signalfd inside the event loop, so a child
+ * that crashes or hangs never blocks the other sessions. With -E every client
+ * is served in-process by the plugin instead, on the same loop. With -U every
+ * client is proxied to a backend chosen by the balancer.
+ *
+ * @param port Port number to listen on.
+ * @param listen_fd Listening socket to serve, -1 to create one on port.
+ * @param drain_fd Becomes readable when the listener was handed off, -1 if it never is.
+ * @param command Command string executed for every client, NULL with -E or -U.
+ * @param in_fd Child stdin, -1 to use the client socket.
+ * @param out_fd Child stdout, -1 to use the client socket.
+ * @return int 0 once the server shut down.
+ */
+int mux_server(int port, int listen_fd, int drain_fd, char *command, int in_fd, int out_fd) {
+    static struct mux_server server;
+    static struct evloop loop;
+    static struct reaper reaper;
+    int descriptors[2] = {STDIN_FILENO, STDOUT_FILENO};
+
+    if (ev_init(&loop, 0) == -1 || reaper_init(&reaper, &loop) == -1) {
+        perror("Event loop setup failed");
+        exit(EXIT_FAILURE);
+    }
+    reaper.child_cpus = child_cpus;
+
+    if (listen_fd == -1) {
+        listen_fd = TCP_LISTENER(descriptors, port);
+    }
+    set_nonblocking_socket(listen_fd);
+    if (mux_server_start(&server, &loop, &reaper, listen_fd, command, balancer) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    server.in_fd = in_fd;
+    server.out_fd = out_fd;
+    if (drain_fd != -1 && ev_io_add(&loop, &server.drain_io, drain_fd, EPOLLIN, on_mux_drain, &server) == -1) {
+        perror("Event registration failed");
+        exit(EXIT_FAILURE);
+    }
+    printf("TCP MUX server listening on port %d\n", port);
+    fflush(stdout);
+
+    long long remaining = session_remaining();
+    if (remaining >= 0) {
+        ev_timer_start(&loop, &server.session_timer, remaining, on_mux_timeout, &server);
+    }
+
+    ev_run(&loop);
+
+    mux_server_close(&server);
+    reaper_close(&reaper, &loop);
+    ev_close(&loop);
+    return 0;
+}
+
+/**
+ * @brief Worker processes of a TCPMUXS port and the listeners they serve.
+ */
+struct worker_group {
+    struct evloop loop;
+    struct reaper reaper;
+    struct child children[WORKERS_MAX];
+    int listeners[WORKERS_MAX];
+    int nlisteners;
+    int running;
+    int failed;
+    int handoff_fd;           // -X socket a successor connects to, -1 without -X
+    struct ev_io handoff_io;
+    int drain_pipe[2];        // Closed to make the workers drain
+};
+
+/**
+ * @brief A worker exited; the group is done once all of them did.
+ */
+static void on_worker_exit(struct evloop *loop, struct child *child, int status) {
+    struct worker_group *group = child->arg;
+    if (exit_code(status) != 0) {
+        fprintf(stderr, "Worker %d failed\n", (int)(child - group->children) + 1);
+        group->failed = 1;
+    }
+    if (--group->running == 0) {
+        ev_stop(loop);
+    }
+}
+
+/**
+ * @brief A successor connected to the handoff socket: pass it the listeners and drain.
+ *
+ * The socket is unlinked first, so the successor can bind its own at the
+ * same path as soon as it has the listeners. Connections queued on them
+ * are accepted by the successor; the workers only finish their sessions.
+ */
+static void on_handoff(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct worker_group *group = io->arg;
+    (void)events;
+
+    int conn = accept4(group->handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (conn == -1) {
+        return;
+    }
+    ev_io_del(loop, io);
+    close(group->handoff_fd);
+    unlink(handoff_path);
+    group->handoff_fd = -1;
+
+    if (handoff_send(conn, group->listeners, group->nlisteners) == -1) {
+        perror("Handoff failed, serving on");  // The successor fails to start instead
+        close(conn);
+        return;
+    }
+    close(conn);
+    for (int i = 0; i < group->nlisteners; i++) {
+        close(group->listeners[i]);
+    }
+    close(group->drain_pipe[1]);
+    printf("Handed off %d listeners, draining %d workers\n", group->nlisteners, group->running);
+    fflush(stdout);
+}
+
+/**
+ * @brief Listeners passed in by a predecessor (-X) or a socket activation manager.
+ *
+ * @param port Port the listeners must be bound to.
+ * @param fds Filled with the listeners.
+ * @return int Number of listeners, 0 if they have to be created.
+ */
+static int inherited_listeners(int port, int *fds) {
+    int n = 0;
+    if (handoff_path != NULL) {
+        n = handoff_receive(handoff_path, fds, WORKERS_MAX);
+        if (n == -1) {
+            perror("Handoff failed");
+            exit(EXIT_FAILURE);
+        }
+        if (n > 0) {
+            printf("Took over %d listeners from %s\n", n, handoff_path);
+        }
+    }
+    if (n == 0) {
+        n = listen_fds_inherited(fds, WORKERS_MAX);
+    }
+
+    for (int i = 0; i < n; i++) {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        if (getsockname(fds[i], (struct sockaddr *)&addr, &len) == -1 || addr.sin_family != AF_INET ||
+            ntohs(addr.sin_port) != port) {
+            fprintf(stderr, "Inherited descriptor %d is not a listener on port %d\n", fds[i], port);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Serve a TCPMUXS port from -j worker processes.
+ *
+ * Every worker owns one listener of a SO_REUSEPORT group and its own event
+ * loop, so no lock or descriptor is shared on the accept path. With -a the
+ * workers are pinned to the given CPUs in turn, and the group is steered so
+ * a connection is accepted by the worker on the CPU that received it; its
+ * relay buffers then stay in that CPU's cache and NUMA node.
+ *
+ * Listeners handed over by a predecessor or passed through LISTEN_FDS are
+ * served as they are; only missing ones are bound. With -X the parent keeps
+ * its copies of the listeners for the next successor.
+ *
+ * @param port Port number to listen on.
+ * @param command Command string executed for every client, NULL with -E or -U.
+ * @param in_fd Child stdin, -1 to use the client socket.
+ * @param out_fd Child stdout, -1 to use the client socket.
+ * @return int 0 once every worker shut down, 1 if one of them failed.
+ */
+int mux_workers(int port, char *command, int in_fd, int out_fd) {
+    static struct worker_group group;
+    int descriptors[2] = {STDIN_FILENO, STDOUT_FILENO};
+    int cpus[WORKERS_MAX];
+
+    group.nlisteners = inherited_listeners(port, group.listeners);
+    if (group.nlisteners > workers) {
+        printf("Serving %d inherited listeners with as many workers\n", group.nlisteners);
+        workers = group.nlisteners;
+    }
+    if (workers <= 1 && handoff_path == NULL) {
+        return mux_server(port, group.nlisteners > 0 ? group.listeners[0] : -1, -1, command, in_fd, out_fd);
+    }
+
+    for (int i = 0; i < workers; i++) {
+        cpus[i] = nworker_cpus > 0 ? worker_cpus[i % nworker_cpus] : -1;
+    }
+    for (int i = group.nlisteners; i < workers; i++) {
+        // Joining order is the group index the steering program returns
+        group.listeners[i] = TCP_LISTENER_GROUP(descriptors, port, 1, cpus[i]);
+    }
+    group.nlisteners = workers;
+    if (nworker_cpus > 0 && reuseport_steer(group.listeners[0], cpus, workers) == -1) {
+        perror("Warning: connection steering unavailable");
+    }
+
+    group.handoff_fd = group.drain_pipe[0] = group.drain_pipe[1] = -1;
+    if (handoff_path != NULL) {
+        group.handoff_fd = handoff_listen(handoff_path);
+        if (group.handoff_fd == -1 || pipe2(group.drain_pipe, O_CLOEXEC) == -1) {
+            perror("Handoff socket setup failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    // The reaper blocks SIGCHLD before the first fork, so no worker exit is missed
+    if (ev_init(&group.loop, 0) == -1 || reaper_init(&group.reaper, &group.loop) == -1 ||
+        (group.handoff_fd != -1 &&
+         ev_io_add(&group.loop, &group.handoff_io, group.handoff_fd, EPOLLIN, on_handoff, &group) == -1)) {
+        perror("Event loop setup failed");
+        exit(EXIT_FAILURE);
+    }
+    fflush(stdout);
+
+    for (int i = 0; i < workers; i++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("Fork failed");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            reaper_child_setup(&group.reaper);
+            close(group.reaper.sfd);
+            ev_close(&group.loop);  // Closing the copies leaves the parent's registrations alone
+            if (group.handoff_fd != -1) {
+                close(group.handoff_fd);
+                close(group.drain_pipe[1]);
+            }
+            if (cpus[i] >= 0 && pin_to_cpus(&cpus[i], 1) == -1) {
+                perror("Warning: pinning worker failed");
+            }
+            for (int j = 0; j < workers; j++) {
+                if (j != i) {
+                    close(group.listeners[j]);
+                }
+            }
+            if (cpus[i] >= 0) {
+                printf("Worker %d started on CPU %d\n", i + 1, cpus[i]);
+            } else {
+                printf("Worker %d started\n", i + 1);
+            }
+            exit(mux_server(port, group.listeners[i], group.drain_pipe[0], command, in_fd, out_fd));
+        }
+        group.children[i].on_exit = on_worker_exit;
+        group.children[i].arg = &group;
+        reaper_adopt(&group.reaper, &group.children[i], pid);
+        group.running++;
+    }
+
+    if (handoff_path == NULL) {
+        for (int i = 0; i < workers; i++) {
+            close(group.listeners[i]);
+        }
+    } else {
+        close(group.drain_pipe[0]);
+        printf("Handoff socket ready at %s\n", handoff_path);
+        fflush(stdout);
+    }
+
+    ev_run(&group.loop);
+
+    if (group.handoff_fd != -1) {
+        // Shut down rather than handed off: the socket must not outlive the listeners
+        close(group.handoff_fd);
+        unlink(handoff_path);
+    }
+    reaper_close(&group.reaper, &group.loop);
+    ev_close(&group.loop);
+    return group.failed;
+}
+
+/**
+ * @brief A configured route served by the daemon: one TCPMUXS server.
+ */
+struct route {
+    struct route_spec spec;
+    char command[ROUTE_ARG_MAX];  // Copy of spec.arg, tokenized by split_command()
+    struct balancer backends;
+    struct mux_server server;
+    struct route *next;
+};
+
+/**
+ * @brief Every route of the configuration file, on one loop.
+ */
+struct route_daemon {
+    struct evloop loop;
+    struct reaper reaper;
+    int sfd;                  // signalfd of SIGHUP, SIGINT and SIGTERM
+    struct ev_io signal_io;
+    struct ev_timer session_timer;
+    struct route *routes;     // Routes accepting clients
+    int nretiring;            // Routes finishing their sessions after a reload or shutdown
+    int stopping;
+};
+
+static struct route_daemon route_daemon;
+
+/**
+ * @brief Bind a route's listener, failing without exiting.
+ *
+ * @return int The non-blocking listening socket, or -1 after printing the reason.
+ */
+static int route_listen(const struct route_spec *spec) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(spec->port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (fd == -1 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, listen_backlog) == -1) {
+        fprintf(stderr, "Route %s: listening on port %d failed: %s\n", spec->name, spec->port, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief A retired route served its last client: free it.
+ */
+static void on_route_drained(struct mux_server *server) {
+    struct route *r = server->arg;
+    fprintf(stderr, "Route %s: retired\n", r->spec.name);
+    mux_server_close(server);
+    free(r);
+    if (--route_daemon.nretiring == 0 && route_daemon.stopping) {
+        ev_stop(&route_daemon.loop);
+    }
+}
+
+/**
+ * @brief Stop accepting on a route; its sessions run to their end.
+ *
+ * @param r Route, unlinked from the active list by the caller.
+ */
+static void route_retire(struct route *r) {
+    r->server.on_drained = on_route_drained;
+    route_daemon.nretiring++;
+    if (route_daemon.stopping) {
+        mux_shutdown(&r->server);  // Shutdown terminates children instead of waiting for them
+        return;
+    }
+    mux_stop_accepting(&r->server);
+    if (r->server.nclients == 0) {
+        on_route_drained(&r->server);
+    }
+}
+
+/**
+ * @brief Start serving a route.
+ *
+ * @param spec Route to serve.
+ * @param listen_fd Listener of the route it replaces, -1 to bind one.
+ *                  It is only taken over on success; on failure the caller still owns it.
+ * @return struct route* The route, or NULL after printing the reason.
+ */
+static struct route *route_open(const struct route_spec *spec, int listen_fd) {
+    struct route *r = calloc(1, sizeof(*r));
+    if (r == NULL) {
+        perror("Allocation failed");
+        return NULL;
+    }
+    r->spec = *spec;
+    strcpy(r->command, spec->arg);
+
+    struct balancer *backends = NULL;
+    if (spec->action == ROUTE_PROXY) {
+        if (balancer_init(&r->backends, spec->arg, spec->policy) == -1) {
+            free(r);
+            return NULL;
+        }
+        backends = &r->backends;
+    }
+    int fd = listen_fd != -1 ? listen_fd : route_listen(spec);
+    if (fd == -1) {
+        if (backends != NULL) {
+            balancer_close(backends);
+        }
+        free(r);
+        return NULL;
+    }
+    if (mux_server_start(&r->server, &route_daemon.loop, &route_daemon.reaper, fd,
+                         backends == NULL ? r->command : NULL, backends) == -1) {
+        r->server.listen_fd = -1;  // Never registered, and a handed over listener stays with its owner
+        if (fd != listen_fd) {
+            close(fd);
+        }
+        mux_server_close(&r->server);
+        free(r);
+        return NULL;
+    }
+    r->server.arg = r;
+    fprintf(stderr, "Route %s: port %d, %s %s\n", spec->name, spec->port,
+            spec->action == ROUTE_PROXY ? "proxy to" : "exec", spec->arg);
+    return r;
+}
+
+/**
+ * @brief Read the configuration and bring the routes in line with it.
+ *
+ * Routes are matched by port. An unchanged route keeps its listener and
+ * sessions. A changed route is replaced only once its new definition is
+ * up: the replacement takes over the listener, so no connect is refused,
+ * and the old sessions finish under the old definition. If the new
+ * definition cannot be served, the old one stays. Routes whose port is no
+ * longer configured stop accepting and retire once their sessions end.
+ *
+ * @return int 0 on success, -1 if the file is invalid and nothing changed.
+ */
+static int daemon_load(void) {
+    struct route_spec *specs;
+    int n = config_load(config_path, &specs);
+    if (n == -1) {
+        return -1;
+    }
+
+    struct route *kept = NULL;     // Routes of the new configuration
+    struct route *retired = NULL;  // Routes to retire once all are in place
+    for (int i = 0; i < n; i++) {
+        struct route **link = &route_daemon.routes;
+        while (*link != NULL && (*link)->spec.port != specs[i].port) {
+            link = &(*link)->next;
+        }
+        struct route *old = *link;
+        if (old != NULL) {
+            *link = old->next;
+        }
+
+        struct route *r = old;
+        if (old == NULL || !route_spec_equal(&specs[i], &old->spec)) {
+            if (old != NULL) {
+                ev_io_del(&route_daemon.loop, &old->server.listen_io);  // A listener is watched once
+            }
+            r = route_open(&specs[i], old != NULL ? old->server.listen_fd : -1);
+            if (r == NULL && old != NULL) {
+                fprintf(stderr, "Route %s: keeping the previous definition\n", old->spec.name);
+                if (ev_io_add(&route_daemon.loop, &old->server.listen_io, old->server.listen_fd, EPOLLIN,
+                              on_mux_accept, &old->server) == -1) {
+                    perror("Event registration failed");
+                }
+                r = old;
+            } else if (old != NULL) {
+                old->server.listen_fd = -1;  // Now served by the replacement
+                old->next = retired;
+                retired = old;
+            }
+        }
+        if (r != NULL) {
+            r->next = kept;
+            kept = r;
+        }
+    }
+
+    // Whatever is left has no port in the new configuration
+    while (route_daemon.routes != NULL) {
+        struct route *r = route_daemon.routes;
+        route_daemon.routes = r->next;
+        r->next = retired;
+        retired = r;
+    }
+    route_daemon.routes = kept;
+    while (retired != NULL) {
+        struct route *r = retired;
+        retired = r->next;
+        route_retire(r);
+    }
+    free(specs);
+    return 0;
+}
+
+/**
+ * @brief Stop accepting on every route and retire them all.
+ */
+static void daemon_stop(void) {
+    route_daemon.stopping = 1;
+    while (route_daemon.routes != NULL) {
+        struct route *r = route_daemon.routes;
+        route_daemon.routes = r->next;
+        route_retire(r);
+    }
+    if (route_daemon.nretiring == 0) {
+        ev_stop(&route_daemon.loop);
+    }
+}
+
+/**
+ * @brief SIGHUP reloads the configuration, SIGINT and SIGTERM shut down.
+ */
+static void on_daemon_signal(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct signalfd_siginfo info;
+    while (read(route_daemon.sfd, &info, sizeof(info)) == sizeof(info)) {
+        if (route_daemon.stopping) {
+            continue;
+        }
+        if (info.ssi_signo == SIGHUP) {
+            fprintf(stderr, "Reloading %s\n", config_path);
+            if (daemon_load() == -1) {
+                fprintf(stderr, "Reload failed, keeping the previous routes\n");
+            }
+        } else {
+            fprintf(stderr, "Shutting down\n");
+            daemon_stop();
+        }
+    }
+}
+
+/**
+ * @brief -t expiry of the daemon.
+ */
+static void on_daemon_timeout(struct evloop *loop, struct ev_timer *timer) {
+    fprintf(stderr, "Timeout expired, shutting down\n");
+    daemon_stop();
+}
+
+/**
+ * @brief Serve every route of the -F configuration from one event loop.
+ *
+ * Each route is a TCPMUXS server, with a -e style command or a -U style
+ * backend list, and all of them share the loop, the reaper and the
+ * process. Global options such as -m, -M, -R, -S, -H, -B, -C and -Z apply
+ * to every route.
+ *
+ * @return int 0 once the daemon shut down, 1 if the configuration is invalid.
+ */
+int route_daemon_run(void) {
+    if (ev_init(&route_daemon.loop, 0) == -1 || reaper_init(&route_daemon.reaper, &route_daemon.loop) == -1) {
+        perror("Event loop setup failed");
+        exit(EXIT_FAILURE);
+    }
+    route_daemon.reaper.child_cpus = child_cpus;
+    ev_timer_init(&route_daemon.session_timer);
+
+    // Blocked only after the reaper saved the mask that children get back
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    route_daemon.sfd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (route_daemon.sfd == -1 || ev_io_add(&route_daemon.loop, &route_daemon.signal_io, route_daemon.sfd, EPOLLIN,
+                                            on_daemon_signal, NULL) == -1) {
+        perror("Signal setup failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (daemon_load() == -1) {
+        return 1;
+    }
+    if (route_daemon.routes == NULL) {
+        fprintf(stderr, "%s declares no route that could be served\n", config_path);
+        return 1;
+    }
+    long long remaining = session_remaining();
+    if (remaining >= 0) {
+        ev_timer_start(&route_daemon.loop, &route_daemon.session_timer, remaining, on_daemon_timeout, NULL);
+    }
+    printf("Daemon serving %s\n", config_path);
+    fflush(stdout);
+
+    ev_run(&route_daemon.loop);
+
+    ev_io_del(&route_daemon.loop, &route_daemon.signal_io);
+    close(route_daemon.sfd);
+    reaper_close(&route_daemon.reaper, &route_daemon.loop);
+    ev_close(&route_daemon.loop);
+    return 0;
+}
+
+/**
+ * @brief Parse a decimal option value that must lie within a range.
+ *
+ * @param value Option argument.
+ * @param min Smallest accepted value.
+ * @param max Largest accepted value.
+ * @param out Set to the value on success.
+ * @return int 0 on success, -1 if the value is malformed or out of range.
+ */
+int parse_range(const char *value, long min, long max, long *out) {
+    char *end;
+    errno = 0;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || n < min || n > max) {
+        return -1;
+    }
+    *out = n;
+    return 0;
+}
+
+/**
+ * @brief Parse a -C value "BYTES[,MICROSECONDS]" into the coalescing settings.
+ *
+ * @param value Option argument.
+ * @return int 0 on success, -1 if the value is malformed or out of range.
+ */
+int parse_coalesce(const char *value) {
+    char *end;
+    unsigned long bytes = strtoul(value, &end, 10);
+    if (end == value || bytes == 0 || bytes > BUFFER_SIZE) {
+        return -1;
+    }
+    if (*end == ',') {
+        const char *us = end + 1;
+        long deadline = strtol(us, &end, 10);
+        if (end == us || deadline <= 0) {
+            return -1;
+        }
+        coalesce_us = deadline;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    coalesce_bytes = bytes;
+    return 0;
+}
+
+/**
+ * @brief Parse a -W value "MIN[,MAX]" into pool sizes; MAX defaults to MIN.
+ *
+ * @param value Option argument.
+ * @param min_idle Set to the connections kept ready per backend.
+ * @param max_idle Set to the idle connections kept at most per backend.
+ * @return int 0 on success, -1 if the value is malformed or out of range.
+ */
+int parse_pool(const char *value, int *min_idle, int *max_idle) {
+    char *end;
+    long min = strtol(value, &end, 10);
+    long max = min;
+    if (end == value || min < 0 || min > POOL_IDLE_MAX) {
+        return -1;
+    }
+    if (*end == ',') {
+        const char *rest = end + 1;
+        max = strtol(rest, &end, 10);
+        if (end == rest || max < min || max > POOL_IDLE_MAX) {
+            return -1;
+        }
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *min_idle = min;
+    *max_idle = max;
+    return 0;
+}
+
+/**
+ * @brief Main function to handle command-line arguments and execute corresponding actions.
+ * 
+ * This function processes command-line arguments, sets up necessary sockets (TCP, UDP, UDS),
+ * handles optional timeout, and manages input/output redirection for executing commands.
+ * 
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return int Exit status.
+ */
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int opt;
+    long number;
+    char *evalue = NULL;
+    char *bvalue = NULL;
+    char *ivalue = NULL;
+    char *ovalue = NULL;
+    char *tvalue = NULL;
+    char *Tvalue = NULL;
+    int exit_status = 0;
+    int pty_mode = 0;
+    int pty_raw = 0;
+    struct winsize winsize;
+    struct winsize *pty_winsize = NULL;
+    char *cvalue = NULL;
+    char *Pvalue = NULL;
+    double replay_speed = 1.0;
+    struct recorder recorder;
+    char *Evalue = NULL;
+    static struct shm_endpoint shm_channels[2];
+    struct shm_endpoint *shm_in = NULL;   // Shared-memory channel read for input
+    struct shm_endpoint *shm_out = NULL;  // Shared-memory channel written with output
+    struct plugin plugin;
+    char *Uvalue = NULL;
+    char *Lvalue = NULL;
+    char *Wvalue = NULL;
+    static struct balancer backends;
+
+    while ((opt = getopt(argc, argv, "e:E:b:i:o:t:T:SR:prw:c:P:q:D:m:M:KU:L:H:W:C:Z:j:a:AB:X:F:")) != -1) {
+        switch (opt) {
+            case 'e':
+                evalue = optarg;
+                break;
+            case 'E':
+                Evalue = optarg;
+                break;
+            case 'K':
+                kernel_relay = 1;
+                break;
+            case 'U':
+                Uvalue = optarg;
+                break;
+            case 'L':
+                Lvalue = optarg;
+                break;
+            case 'H':
+                if (parse_range(optarg, 0, HEALTH_INTERVAL_MAX_MS, &number) == -1) {
+                    fprintf(stderr, "Invalid -H value, expected 0 to %d milliseconds, 0 to disable checks\n",
+                            HEALTH_INTERVAL_MAX_MS);
+                    exit(EXIT_FAILURE);
+                }
+                health_interval = number;
+                break;
+            case 'W':
+                Wvalue = optarg;
+                break;
+            case 'Z':
+                // A threshold above the slot size would never be reached
+                if (parse_range(optarg, 1, ZC_SLOT_SIZE, &number) == -1) {
+                    fprintf(stderr, "Invalid -Z value, expected the smallest write, 1 to %d bytes, e.g. %d\n",
+                            ZC_SLOT_SIZE, ZC_THRESHOLD);
+                    exit(EXIT_FAILURE);
+                }
+                zerocopy_min = number;
+                break;
+            case 'F':
+                config_path = optarg;
+                break;
+            case 'X':
+                handoff_path = optarg;
+                break;
+            case 'B':
+                if (parse_range(optarg, 1, BUSY_POLL_MAX_US, &number) == -1) {
+                    fprintf(stderr, "Invalid -B value, expected a spin budget of 1 to %d microseconds\n",
+                            BUSY_POLL_MAX_US);
+                    exit(EXIT_FAILURE);
+                }
+                busy_poll_us = number;
+                break;
+            case 'j':
+                if (parse_range(optarg, 1, WORKERS_MAX, &number) == -1) {
+                    fprintf(stderr, "Invalid -j value, expected 1 to %d worker processes\n", WORKERS_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                workers = number;
+                break;
+            case 'a':
+                nworker_cpus = cpulist_parse(optarg, worker_cpus, AFFINITY_MAX_CPUS);
+                if (nworker_cpus <= 0) {
+                    fprintf(stderr, "Invalid -a value, expected a CPU list such as 0-3,6 or a node such as node1\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'A':
+                pin_children = 1;
+                break;
+            case 'C':
+                if (parse_coalesce(optarg) == -1) {
+                    fprintf(stderr, "Invalid -C value, expected BYTES[,MICROSECONDS] with 1 <= BYTES <= %d\n",
+                            BUFFER_SIZE);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b':
+                bvalue = optarg;
+                break;
+            case 'i':
+                ivalue = optarg;
+                break;
+            case 'o':
+                ovalue = optarg;
+                break;
+            case 't':
+                tvalue = optarg;
+                break;
+            case 'T':
+                Tvalue = optarg;
+                break;
+            case 'S':
+                status_frames = 1;
+                break;
+            case 'R':
+                if (parse_range(optarg, 0, RESTARTS_MAX, &number) == -1) {
+                    fprintf(stderr, "Invalid -R value, expected 0 to %d restarts\n", RESTARTS_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                max_restarts = number;
+                break;
+            case 'p':
+                pty_mode = 1;
+                break;
+            case 'r':
+                pty_raw = 1;
+                break;
+            case 'w':
+                if (parse_winsize(optarg, &winsize) == -1) {
+                    fprintf(stderr, "Invalid -w value, expected COLSxROWS\n");
+                    exit(EXIT_FAILURE);
+                }
+                pty_winsize = &winsize;
+                break;
+            case 'c':
+                cvalue = optarg;
+                break;
+            case 'q':
+                if (parse_range(optarg, 1, INT_MAX, &number) == -1) {
+                    fprintf(stderr, "Invalid -q value, expected an accept queue length of 1 to %d\n", INT_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                listen_backlog = number;
+                break;
+            case 'D':
+                if (parse_range(optarg, 1, DEFER_ACCEPT_MAX, &number) == -1) {
+                    fprintf(stderr, "Invalid -D value, expected 1 to %d seconds\n", DEFER_ACCEPT_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                defer_accept = number;
+                break;
+            case 'm':
+                if (parse_range(optarg, 1, INT_MAX, &number) == -1) {
+                    fprintf(stderr, "Invalid -m value, expected 1 to %d concurrent sessions\n", INT_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                max_sessions = number;
+                break;
+            case 'M':
+                if (parse_range(optarg, 1, INT_MAX, &number) == -1) {
+                    fprintf(stderr, "Invalid -M value, expected 1 to %d sessions per address\n", INT_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                max_per_ip = number;
+                break;
+            case 'P':
+                Pvalue = optarg;
+                if (parse_replay(Pvalue, &replay_speed) == -1) {
+                    fprintf(stderr, "Invalid -P value, expected FILE[,SPEED|max]\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (tvalue != NULL) {
+        if (parse_range(tvalue, 1, TIMEOUT_MAX_S, &number) == -1) {
+            fprintf(stderr, "Invalid -t value, expected 1 to %d seconds\n", TIMEOUT_MAX_S);
+            exit(EXIT_FAILURE);
+        }
+        session_deadline = monotonic_ms() + number * 1000LL;  // Total session timeout
+    }
+    if (Tvalue != NULL) {
+        if (parse_range(Tvalue, 1, TIMEOUT_MAX_S, &number) == -1) {
+            fprintf(stderr, "Invalid -T value, expected 1 to %d seconds\n", TIMEOUT_MAX_S);
+            exit(EXIT_FAILURE);
+        }
+        idle_timeout = number * 1000UL;  // Idle timeout of relayed sessions
+    }
+
+    if (Evalue != NULL) {
+        if (evalue != NULL || Pvalue != NULL || pty_mode) {
+            fprintf(stderr, "-E cannot be combined with -e, -P or -p\n");
+            exit(EXIT_FAILURE);
+        }
+        if (plugin_load(&plugin, Evalue) == -1) {
+            exit(EXIT_FAILURE);
+        }
+        handler = &plugin;
+    }
+
+    if (Uvalue != NULL) {
+        if (evalue != NULL || handler != NULL || Pvalue != NULL || pty_mode) {
+            fprintf(stderr, "-U cannot be combined with -e, -E, -P or -p\n");
+            exit(EXIT_FAILURE);
+        }
+        if (bvalue == NULL || strncmp(bvalue, "TCPMUXS", 7) != 0) {
+            fprintf(stderr, "-U requires -b TCPMUXS<port>\n");  // Every client needs its own backend connection
+            exit(EXIT_FAILURE);
+        }
+        if (balancer_init(&backends, Uvalue, Lvalue) == -1) {
+            exit(EXIT_FAILURE);
+        }
+        balancer = &backends;
+        if (Wvalue != NULL) {
+            int min_idle, max_idle;
+            if (parse_pool(Wvalue, &min_idle, &max_idle) == -1) {
+                fprintf(stderr, "Invalid -W value, expected MIN[,MAX] with 0 <= MIN <= MAX <= %d\n", POOL_IDLE_MAX);
+                exit(EXIT_FAILURE);
+            }
+            balancer_pool(balancer, min_idle, max_idle);
+        }
+    } else if (Lvalue != NULL || Wvalue != NULL) {
+        fprintf(stderr, "-L and -W require -U\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (nworker_cpus > 0) {
+        if (!pin_children) {
+            sched_getaffinity(0, sizeof(original_cpus), &original_cpus);
+            child_cpus = &original_cpus;  // -a pins mync, not the programs it runs
+        }
+        // Pin before anything is allocated, so first touch places memory on the CPUs' node
+        if (workers <= 1 && pin_to_cpus(worker_cpus, nworker_cpus) == -1) {
+            perror("Pinning to -a CPUs failed");
+            exit(EXIT_FAILURE);
+        }
+    } else if (pin_children) {
+        fprintf(stderr, "-A requires -a\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (config_path != NULL) {
+        if (evalue != NULL || handler != NULL || Uvalue != NULL || bvalue != NULL || ivalue != NULL ||
+            ovalue != NULL || Pvalue != NULL || cvalue != NULL || pty_mode || workers > 1 || handoff_path != NULL) {
+            fprintf(stderr, "-F cannot be combined with -e, -E, -U, -b, -i, -o, -P, -c, -p, -j or -X\n");
+            exit(EXIT_FAILURE);
+        }
+        return route_daemon_run();
+    }
+
+    if (cvalue != NULL) {
+        if (recorder_open(&recorder, cvalue) == -1) {
+            perror("Open capture failed");
+            exit(EXIT_FAILURE);
+        }
+        capture = &recorder;
+    }
+
+    int descriptors[2] = {STDIN_FILENO, STDOUT_FILENO};
+    int mux_port = 0;   // TCPMUXS port, 0 when not serving multiple clients
+    int mux_in = 0;     // Client sockets become the children's stdin
+    int mux_out = 0;    // Client sockets become the children's stdout
+
+    if (bvalue != NULL && (ivalue != NULL || ovalue != NULL)) {
+        fprintf(stderr, "Option -b cannot be used with -i or -o\n");
+        fprintf(stderr, "Usage: %s -e <value> [-b <value>] [-i <value>] [-o <value>]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (ivalue != NULL) {
+        printf("Processing -i option: %s\n", ivalue);
+        if (strncmp(ivalue, "TCPMUXS", 7) == 0) {
+            mux_port = atoi(ivalue + 7);  // Clients are accepted by mux_server()
+            mux_in = 1;
+        } else if (strncmp(ivalue, "TCPS", 4) == 0) {
+            ivalue += 4;
+            int port = atoi(ivalue);
+            TCP_SERVER(descriptors, port, NULL, 0);  // Setup TCP server
+        } else if (strncmp(ivalue, "UDPS", 4) == 0) {
+            ivalue += 4;
+            int port = atoi(ivalue);
+            UDP_SERVER(descriptors, port, 0);  // Setup UDP server
+        } else if (strncmp(ivalue, "UDSSS", 5) == 0) {
+            ivalue += 5;
+            printf("Unix Domain Socket Server Path: %s\n", ivalue);
+            UDS_SERVER_STREAM(ivalue, descriptors);  // Setup UDS server
+        } else if (strncmp(ivalue, "UDSCS", 5) == 0) {
+            ivalue += 5;
+            UDS_CLIENT_STREAM(ivalue, descriptors);  // Setup UDS client
+            descriptors[0] = descriptors[1];
+            descriptors[1] = STDOUT_FILENO;
+        } else if (strncmp(ivalue, "TCPC", 4) == 0) {
+            ivalue += 4;
+            char *ip_server = strtok(ivalue, ",");
+            if (ip_server == NULL) {
+                fprintf(stderr, "Invalid server IP\n");
+                close_descriptors(descriptors);
+                exit(EXIT_FAILURE);
+            }
+            char *port_server = strtok(NULL, ",");
+            if (port_server == NULL) {
+                fprintf(stderr, "Invalid server port\n");
+                close_descriptors(descriptors);
+                exit(EXIT_FAILURE);
+            }
+            int port = atoi(port_server);
+            TCP_client(descriptors, ip_server, port, NULL, 1);  // Setup TCP client
+        } else if (strncmp(ivalue, "UDPC", 4) == 0) {
+            ivalue += 4;
+            char *ip_server = strtok(ivalue, ",");
+            if (ip_server == NULL) {
+                fprintf(stderr, "Invalid server IP\n");
+                close_descriptors(descriptors);
+                exit(EXIT_FAILURE);
+            }
+            char *port_server = strtok(NULL, ",");
+            if (port_server == NULL) {
+                fprintf(stderr, "Invalid server port\n");
+                close_descriptors(descriptors);
+                exit(EXIT_FAILURE);
+            }
+            int port = atoi(port_server);
+            UDP_CLIENT(descriptors, ip_server, port, 1);  // Setup UDP client
+        } else if (strncmp(ivalue, "SHM", 3) == 0) {
+            shm_in = &shm_channels[0];
+            SHM_ENDPOINT(ivalue + 3, shm_in, descriptors);
+            shm_close_write(shm_in);  // Input only
+        } else {
+            fprintf(stderr, "Invalid -i value\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (ovalue != NULL) {
         printf("Processing -o option: %s\n", ovalue);
-        if (strncmp(ovalue, "TCPC", 4) == 0) {
+        if (strncmp(ovalue, "TCPMUXS", 7) == 0) {
+            if (mux_port != 0) {
+                fprintf(stderr, "Use -b for a TCPMUXS server on both input and output\n");
+                exit(EXIT_FAILURE);
+            }
+            mux_port = atoi(ovalue + 7);  // Clients are accepted by mux_server()
+            mux_out = 1;
+        } else if (strncmp(ovalue, "TCPC", 4) == 0) {
             ovalue += 4;
             char *ip_server = strtok(ovalue, ",");
             if (ip_server == NULL) {
@@ -584,16 +3937,16 @@ int main(int argc, char *argv[]) {
         } else if (strncmp(ovalue, "UDPS", 4) == 0) {
             ovalue += 4;
             int port = atoi(ovalue);
-            if (tvalue != NULL) {
-                UDP_SERVER(descriptors, port, atoi(tvalue), 1);  // Setup UDP server with timeout
-            } else {
-                UDP_SERVER(descriptors, port, 0, 1);  // Setup UDP server without timeout
-            }
+            UDP_SERVER(descriptors, port, 1);  // Setup UDP server
         } else if (strncmp(ovalue, "UDSSS", 5) == 0) {
             ovalue += 5;
             UDS_SERVER_STREAM(ovalue, descriptors);  // Setup UDS server
             descriptors[1] = descriptors[0];
             descriptors[0] = STDIN_FILENO;
+        } else if (strncmp(ovalue, "SHM", 3) == 0) {
+            shm_out = &shm_channels[1];
+            SHM_ENDPOINT(ovalue + 3, shm_out, descriptors);
+            shm_close_read(shm_out);  // Output only
         } else {
             fprintf(stderr, "Invalid -o value\n");
             close_descriptors(descriptors);
@@ -603,7 +3956,10 @@ int main(int argc, char *argv[]) {
 
     if (bvalue != NULL) {
         printf("Processing -b option: %s\n", bvalue);
-        if (strncmp(bvalue, "TCPS", 4) == 0) {
+        if (strncmp(bvalue, "TCPMUXS", 7) == 0) {
+            mux_port = atoi(bvalue + 7);  // Clients are accepted by mux_server()
+            mux_in = mux_out = 1;
+        } else if (strncmp(bvalue, "TCPS", 4) == 0) {
             bvalue += 4;
             int port = atoi(bvalue);
             TCP_SERVER(descriptors, port, bvalue, 0);  // Setup TCP server
@@ -643,7 +3999,7 @@ int main(int argc, char *argv[]) {
         } else if (strncmp(bvalue, "UDPS", 4) == 0) {
             bvalue += 4;
             int port = atoi(bvalue);
-            UDP_SERVER(descriptors, port, 0, 0);  // Setup UDP server
+            UDP_SERVER(descriptors, port, 0);  // Setup UDP server
             descriptors[1] = descriptors[0];
         } else if (strncmp(bvalue, "UDSSS", 5) == 0) {
             bvalue += 5;
@@ -653,6 +4009,9 @@ int main(int argc, char *argv[]) {
             bvalue += 5;
             UDS_CLIENT_STREAM(bvalue, descriptors);  // Setup UDS client
             descriptors[0] = descriptors[1];
+        } else if (strncmp(bvalue, "SHM", 3) == 0) {
+            shm_in = shm_out = &shm_channels[0];
+            SHM_ENDPOINT(bvalue + 3, shm_in, descriptors);
         } else {
             fprintf(stderr, "Invalid -b value\n");
             close_descriptors(descriptors);
@@ -660,7 +4019,52 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (evalue != NULL) {
+    if ((workers > 1 || handoff_path != NULL) && mux_port == 0) {
+        fprintf(stderr, "-j and -X require a TCPMUXS server\n");
+        close_descriptors(descriptors);
+        exit(EXIT_FAILURE);
+    }
+
+    if (mux_port != 0) {
+        if (evalue == NULL && handler == NULL && balancer == NULL) {
+            fprintf(stderr, "TCPMUXS requires -e, -E or -U\n");
+            close_descriptors(descriptors);
+            exit(EXIT_FAILURE);
+        }
+        if (handler != NULL && !(mux_in && mux_out)) {
+            fprintf(stderr, "-E with TCPMUXS requires -b\n");  // Sessions cannot share one stdin or stdout
+            close_descriptors(descriptors);
+            exit(EXIT_FAILURE);
+        }
+        if (capture != NULL) {
+            fprintf(stderr, "Capture is not supported with TCPMUXS\n");
+            exit(EXIT_FAILURE);
+        }
+        exit_status = mux_workers(mux_port, evalue, mux_in ? -1 : descriptors[0], mux_out ? -1 : descriptors[1]);
+    } else if (shm_in != NULL || shm_out != NULL) {
+        if (handler != NULL || Pvalue != NULL || pty_mode || capture != NULL) {
+            fprintf(stderr, "SHM endpoints cannot be combined with -E, -P, -p or -c\n");
+            exit(EXIT_FAILURE);
+        }
+        if (evalue != NULL) {
+            printf("Executing command: %s\n", evalue);
+            fflush(stdout);
+            exit_status = RUN_SHM(evalue, shm_in, shm_out, descriptors);
+        } else if (shm_relay(shm_in, shm_out, descriptors, bvalue != NULL) == -1) {
+            exit_status = EXIT_FAILURE;
+        }
+    } else if (Pvalue != NULL) {
+        fflush(stdout);
+        exit_status = REPLAY(Pvalue, replay_speed, evalue, descriptors, pty_mode, pty_raw, pty_winsize);
+    } else if (handler != NULL) {
+        printf("Serving with plugin: %s\n", handler->api->name);
+        fflush(stdout);
+        exit_status = RUN_PLUGIN(descriptors);
+    } else if (evalue != NULL && (pty_mode || capture != NULL || coalesce_bytes > 0)) {
+        printf("Executing command%s: %s\n", pty_mode ? " on a pseudo-terminal" : "", evalue);
+        fflush(stdout);
+        exit_status = RUN_RELAYED(evalue, descriptors, pty_mode, pty_raw, pty_winsize);
+    } else if (evalue != NULL) {
         printf("Executing command: %s\n", evalue);
         if (descriptors[0] != STDIN_FILENO) {
             if (dup2(descriptors[0], STDIN_FILENO) == -1) {
@@ -684,82 +4088,26 @@ int main(int argc, char *argv[]) {
                 exit(EXIT_FAILURE);
             }
         }
-        RUN(evalue);  // Execute the command
+        exit_status = RUN(evalue);  // Execute the command
     } else {
         printf("No command provided for execution\n");
-        struct pollfd fds[4] = {
-            {descriptors[0], POLLIN, 0},
-            {descriptors[1], POLLIN, 0},
-            {STDIN_FILENO, POLLIN, 0},
-            {STDOUT_FILENO, POLLIN, 0}
-        };
-
-        while (1) {
-            int ret = poll(fds, 4, -1);
-            if (ret == -1) {
-                perror("Poll failed");
-                close_descriptors(descriptors);
-                exit(EXIT_FAILURE);
-            }
-
-            if (bvalue == NULL && (fds[0].revents & POLLIN)) {
-                char buffer[1024];
-                int bytes_read = read(fds[0].fd, buffer, sizeof(buffer));
-                if (bytes_read == -1) {
-                    perror("Read failed");
-                    close_descriptors(descriptors);
-                    exit(EXIT_FAILURE);
-                }
-                if (bytes_read == 0) {
-                    break;
-                }
-                if (write(fds[1].fd, buffer, bytes_read) == -1) {
-                    perror("Write failed");
-                    close_descriptors(descriptors);
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            if (bvalue != NULL && (fds[1].revents & POLLIN)) {
-                char buffer[1024];
-                int bytes_read = read(fds[1].fd, buffer, sizeof(buffer));
-                if (bytes_read == -1) {
-                    perror("Read failed");
-                    close_descriptors(descriptors);
-                    exit(EXIT_FAILURE);
-                }
-                if (bytes_read == 0) {
-                    break;
-                }
-                if (write(fds[3].fd, buffer, bytes_read) == -1) {
-                    perror("Write failed");
-                    close_descriptors(descriptors);
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            if (bvalue != NULL && (fds[2].revents & POLLIN)) {
-                char buffer[1024];
-                int bytes_read = read(fds[2].fd, buffer, sizeof(buffer));
-                if (bytes_read == -1) {
-                    perror("Read failed");
-                    close_descriptors(descriptors);
-                    exit(EXIT_FAILURE);
-                }
-                if (bytes_read == 0) {
-                    break;
-                }
-                if (write(descriptors[1], buffer, bytes_read) == -1) {
-                    perror("Write failed");
-                    close_descriptors(descriptors);
-                    exit(EXIT_FAILURE);
-                }
-            }
+        if (kernel_relay && bvalue == NULL && KERNEL_RELAY(descriptors) == 0) {
+            // The kernel relayed the whole session
+        } else if (relay(descriptors, bvalue != NULL) == -1) {
+            close_descriptors(descriptors);
+            exit(EXIT_FAILURE);
         }
     }
 
+    if (capture != NULL) {
+        recorder_close(capture);
+    }
+    if (handler != NULL) {
+        plugin_unload(handler);
+    }
+
     close(descriptors[0]);
     close(descriptors[1]);
 
-    return 0;
+    return exit_status;
 }
@@ -0,0 +1,69 @@
+#ifndef MYNC_PLUGIN_H
+#define MYNC_PLUGIN_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @file mync_plugin.h
+ * @brief Interface of in-process session handlers loaded by mync -E.
+ *
+ * A plugin is a shared object exporting a const struct mync_plugin named
+ * MYNC_PLUGIN_SYMBOL. mync calls init() once per session and keeps the
+ * returned pointer as the session's state, passes every chunk read from the
+ * client to on_data(), then the client's EOF as an empty on_data(), and
+ * calls on_close() exactly once when the session ends. All callbacks run on mync's event loop thread and must not block.
+ */
+
+#define MYNC_PLUGIN_ABI 2  // 2: on_data() is also told about EOF
+#define MYNC_PLUGIN_SYMBOL "mync_plugin"
+
+struct mync_session;  // Opaque, owned by mync
+
+/**
+ * @brief Services mync offers to plugins.
+ */
+struct mync_host {
+    /**
+     * @brief Queue data for the client; never blocks.
+     *
+     * @return ssize_t len, or -1 once the session has failed.
+     */
+    ssize_t (*send)(struct mync_session *session, const void *data, size_t len);
+    /**
+     * @brief End the session once everything queued has been sent.
+     */
+    void (*close)(struct mync_session *session);
+};
+
+/**
+ * @brief Callbacks exported by a plugin.
+ */
+struct mync_plugin {
+    int abi;  // MYNC_PLUGIN_ABI the plugin was built against
+    const char *name;
+    /**
+     * @brief Start a session.
+     *
+     * @param host Host services, valid for the whole session.
+     * @param session Handle to pass to host services.
+     * @param arg Text after the plugin path in -E, "" if none.
+     * @return void* Session state, or NULL to refuse the session.
+     */
+    void *(*init)(const struct mync_host *host, struct mync_session *session, const char *arg);
+    /**
+     * @brief Handle a chunk from the client.
+     *
+     * Called once more with data NULL and len 0 when the client sent EOF;
+     * the session then ends after pending output, whatever is returned.
+     *
+     * @return int 0 to continue, -1 to end the session after pending output.
+     */
+    int (*on_data)(void *state, const char *data, size_t len);
+    /**
+     * @brief Release a session's state.
+     */
+    void (*on_close)(void *state);
+};
+
+#endif
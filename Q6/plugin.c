@@ -0,0 +1,290 @@
+#include "plugin.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static ssize_t host_send(struct mync_session *s, const void *data, size_t len);
+static void host_close(struct mync_session *s);
+
+static const struct mync_host host = {host_send, host_close};
+
+int plugin_load(struct plugin *plugin, const char *spec) {
+    memset(plugin, 0, sizeof(*plugin));
+    plugin->path = strdup(spec);
+    if (plugin->path == NULL) {
+        perror("Allocation failed");
+        return -1;
+    }
+
+    char *space = strchr(plugin->path, ' ');
+    plugin->arg = "";
+    if (space != NULL) {
+        *space = '\0';
+        plugin->arg = space + 1;
+    }
+
+    plugin->handle = dlopen(plugin->path, RTLD_NOW | RTLD_LOCAL);
+    if (plugin->handle == NULL) {
+        fprintf(stderr, "Plugin load failed: %s\n", dlerror());
+        free(plugin->path);
+        return -1;
+    }
+    plugin->api = dlsym(plugin->handle, MYNC_PLUGIN_SYMBOL);
+    if (plugin->api == NULL || plugin->api->abi != MYNC_PLUGIN_ABI || plugin->api->init == NULL ||
+        plugin->api->on_data == NULL || plugin->api->on_close == NULL) {
+        fprintf(stderr, "Plugin %s does not export a valid %s\n", plugin->path, MYNC_PLUGIN_SYMBOL);
+        dlclose(plugin->handle);
+        free(plugin->path);
+        return -1;
+    }
+    return 0;
+}
+
+void plugin_unload(struct plugin *plugin) {
+    dlclose(plugin->handle);
+    free(plugin->path);
+}
+
+/**
+ * @brief Write to the output descriptor without risking SIGPIPE on sockets.
+ */
+static ssize_t session_write(struct mync_session *s, const void *data, size_t len) {
+    if (s->out_socket) {
+        return send(s->out_fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    return write(s->out_fd, data, len);
+}
+
+/**
+ * @brief Write as much of the queue as the output descriptor accepts.
+ *
+ * @return int 0 on success (possibly partial), -1 on a write error.
+ */
+static int session_flush(struct mync_session *s) {
+    while (s->out_len > 0) {
+        ssize_t n = session_write(s, s->out + s->out_off, s->out_len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        s->out_off += n;
+        s->out_len -= n;
+    }
+    s->out_off = 0;
+    return 0;
+}
+
+/**
+ * @brief Stop the session and tell its owner, from inside the loop.
+ */
+static void session_end(struct mync_session *s, int failed) {
+    s->failed |= failed;
+    plugin_session_stop(s);
+    if (s->on_end != NULL) {
+        s->on_end(s->loop, s);
+    }
+}
+
+/**
+ * @brief Recompute the epoll interest of the session's descriptors.
+ *
+ * @return int 0 while the session continues, -1 once it has ended.
+ */
+static int session_update(struct mync_session *s) {
+    if (s->closing && s->out_len == 0) {
+        session_end(s, 0);
+        return -1;
+    }
+
+    uint32_t in = !s->closing && s->out_len < PLUGIN_HIGH_WATER ? EPOLLIN : 0;
+    uint32_t out = s->out_len > 0 ? EPOLLOUT : 0;
+    if (s->nios == 1) {
+        ev_io_mod(s->loop, &s->ios[0], in | out);
+    } else {
+        ev_io_mod(s->loop, &s->ios[0], in);
+        ev_io_mod(s->loop, &s->ios[1], out);
+    }
+    return 0;
+}
+
+/**
+ * @brief mync_host.send: write through when nothing is queued, else queue.
+ */
+static ssize_t host_send(struct mync_session *s, const void *data, size_t len) {
+    if (s->failed || s->stopped) {
+        return -1;
+    }
+    if (s->capture != NULL && recorder_write(s->capture, REC_DIR_OUT, data, len) == -1) {
+        perror("Capture failed");
+        s->capture = NULL;
+    }
+
+    size_t done = 0;
+    while (s->out_len == 0 && done < len) {
+        ssize_t n = session_write(s, (const char *)data + done, len - done);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                s->failed = 1;
+                s->closing = 1;
+                return -1;
+            }
+            break;
+        }
+        done += n;
+    }
+    if (done == len) {
+        return len;
+    }
+
+    if (s->out_off > 0) {
+        memmove(s->out, s->out + s->out_off, s->out_len);
+        s->out_off = 0;
+    }
+    if (s->out_len + (len - done) > s->out_cap) {
+        size_t cap = s->out_cap ? s->out_cap : 4096;
+        while (cap < s->out_len + (len - done)) {
+            cap *= 2;
+        }
+        char *out = realloc(s->out, cap);
+        if (out == NULL) {
+            perror("Allocation failed");
+            s->failed = 1;
+            s->closing = 1;
+            return -1;
+        }
+        s->out = out;
+        s->out_cap = cap;
+    }
+    memcpy(s->out + s->out_len, (const char *)data + done, len - done);
+    s->out_len += len - done;
+    return len;
+}
+
+/**
+ * @brief mync_host.close: stop reading and end once the queue is flushed.
+ */
+static void host_close(struct mync_session *s) {
+    s->closing = 1;
+}
+
+/**
+ * @brief Readiness callback of a session's descriptors.
+ */
+static void on_plugin_io(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct mync_session *s = io->arg;
+
+    if (io->fd == s->out_fd && s->out_len > 0 && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        if (session_flush(s) == -1) {
+            session_end(s, 1);
+            return;
+        }
+    }
+
+    if (io->fd == s->in_fd && !s->closing && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        char buffer[4096];
+        ssize_t n = read(s->in_fd, buffer, sizeof(buffer));
+        if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            session_end(s, 1);
+            return;
+        }
+        if (n == 0) {
+            s->plugin->api->on_data(s->state, NULL, 0);  // Lets the plugin answer the end of input
+            s->closing = 1;
+        } else if (n > 0) {
+            if (s->capture != NULL && recorder_write(s->capture, REC_DIR_IN, buffer, n) == -1) {
+                perror("Capture failed");
+                s->capture = NULL;
+            }
+            if (s->plugin->api->on_data(s->state, buffer, n) == -1) {
+                s->closing = 1;
+            }
+        }
+    }
+
+    if (s->failed) {
+        session_end(s, 1);
+        return;
+    }
+    session_update(s);
+}
+
+int plugin_session_start(struct evloop *loop, struct mync_session *s, const struct plugin *plugin, int in_fd,
+                         int out_fd, plugin_session_cb on_end, void *arg) {
+    struct stat st;
+    struct recorder *capture = s->capture;
+
+    memset(s, 0, sizeof(*s));
+    s->loop = loop;
+    s->plugin = plugin;
+    s->in_fd = in_fd;
+    s->out_fd = out_fd;
+    s->out_socket = fstat(out_fd, &st) == 0 && S_ISSOCK(st.st_mode);
+    s->capture = capture;
+    s->on_end = on_end;
+    s->arg = arg;
+    s->stopped = 1;  // Nothing to undo until registration succeeded
+
+    int fds[2] = {in_fd, out_fd};
+    s->nios = in_fd == out_fd ? 1 : 2;
+    for (int i = 0; i < s->nios; i++) {
+        int flags = fcntl(fds[i], F_GETFL);
+        if (flags != -1) {
+            fcntl(fds[i], F_SETFL, flags | O_NONBLOCK);
+        }
+        if (ev_io_add(loop, &s->ios[i], fds[i], 0, on_plugin_io, s) == -1) {
+            perror("Event registration failed");
+            while (--i >= 0) {
+                ev_io_del(loop, &s->ios[i]);
+            }
+            return -1;
+        }
+    }
+
+    s->stopped = 0;
+    s->state = plugin->api->init(&host, s, plugin->arg);
+    if (s->state == NULL) {
+        s->stopped = 1;
+        for (int i = 0; i < s->nios; i++) {
+            ev_io_del(loop, &s->ios[i]);
+        }
+        session_flush(s);  // Best effort for anything sent before refusing
+        free(s->out);
+        s->out = NULL;
+        return -1;
+    }
+
+    // A session init() already closed ends here, without calling on_end
+    if (s->closing && s->out_len == 0) {
+        plugin_session_stop(s);
+        return -1;
+    }
+    session_update(s);
+    return 0;
+}
+
+void plugin_session_stop(struct mync_session *s) {
+    if (s->stopped) {
+        return;
+    }
+    s->stopped = 1;
+    for (int i = 0; i < s->nios; i++) {
+        ev_io_del(s->loop, &s->ios[i]);
+    }
+    session_flush(s);  // Best effort: the session is over either way
+    s->plugin->api->on_close(s->state);
+    free(s->out);
+    s->out = NULL;
+    s->out_len = 0;
+}
@@ -0,0 +1,91 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <stddef.h>
+
+#include "evloop.h"
+#include "mync_plugin.h"
+#include "record.h"
+
+#define PLUGIN_HIGH_WATER (256 * 1024)  // Pending output above which client input is no longer read
+
+/**
+ * @brief A plugin loaded with dlopen().
+ */
+struct plugin {
+    void *handle;
+    const struct mync_plugin *api;
+    char *path;
+    const char *arg;  // Text after the path, passed to every init()
+};
+
+typedef void (*plugin_session_cb)(struct evloop *loop, struct mync_session *session);
+
+/**
+ * @brief An in-process session: client descriptors bound to a plugin's state.
+ *
+ * Callers embed or allocate this structure per connection. Output the plugin
+ * sends is written immediately when the descriptor accepts it and queued
+ * otherwise; while the queue is above PLUGIN_HIGH_WATER the client is not
+ * read, so a slow client applies backpressure to the plugin.
+ */
+struct mync_session {
+    struct evloop *loop;
+    const struct plugin *plugin;
+    void *state;
+    int in_fd;
+    int out_fd;
+    int out_socket;  // out_fd is a socket, written with MSG_NOSIGNAL
+    struct ev_io ios[2];
+    int nios;
+    char *out;
+    size_t out_off;
+    size_t out_len;
+    size_t out_cap;
+    int closing;  // No more input: end once the queue is empty
+    int failed;
+    int stopped;
+    struct recorder *capture;  // Set before plugin_session_start() to record both directions, or NULL
+    plugin_session_cb on_end;
+    void *arg;
+};
+
+/**
+ * @brief Load a plugin from an -E value "path [arguments]".
+ *
+ * @param plugin Plugin to fill.
+ * @param spec Path of the shared object, optionally followed by arguments.
+ * @return int 0 on success, -1 after printing the reason.
+ */
+int plugin_load(struct plugin *plugin, const char *spec);
+
+/**
+ * @brief Unload a plugin once no session uses it.
+ */
+void plugin_unload(struct plugin *plugin);
+
+/**
+ * @brief Start a session and call the plugin's init().
+ *
+ * @param loop Event loop driving the session.
+ * @param s Session to start.
+ * @param plugin Loaded plugin.
+ * @param in_fd Descriptor read for client data.
+ * @param out_fd Descriptor the plugin's output goes to, possibly in_fd.
+ * @param on_end Called from the loop once the session has stopped by itself.
+ * @param arg Caller data, available as s->arg.
+ * @return int 0 on success, -1 if the plugin refused the session or registration failed.
+ */
+int plugin_session_start(struct evloop *loop, struct mync_session *s, const struct plugin *plugin, int in_fd,
+                         int out_fd, plugin_session_cb on_end, void *arg);
+
+/**
+ * @brief Stop a session: unregister it and call the plugin's on_close().
+ *
+ * Safe to call more than once; descriptors are left to the caller.
+ *
+ * @param s Session.
+ */
+void plugin_session_stop(struct mync_session *s);
+
+#endif
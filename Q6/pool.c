@@ -0,0 +1,177 @@
+#include "pool.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void pool_init(struct conn_pool *p, const struct sockaddr *addr, socklen_t addrlen,
+               void (*on_result)(void *arg, int err), void *arg) {
+    p->addr = addr;
+    p->addrlen = addrlen;
+    p->min_idle = p->max_idle = 0;
+    p->nidle = p->nconnecting = 0;
+    p->conns.next = p->conns.prev = &p->conns;
+    p->loop = NULL;
+    p->on_result = on_result;
+    p->arg = arg;
+    p->hits = p->misses = p->reused = 0;
+}
+
+static void report(struct conn_pool *p, int err) {
+    if (p->on_result != NULL) {
+        p->on_result(p->arg, err);
+    }
+}
+
+static void conn_unlink(struct pool_conn *c) {
+    struct conn_pool *p = c->pool;
+    if (c->connected) {
+        p->nidle--;
+    } else {
+        p->nconnecting--;
+    }
+    c->prev->next = c->next;
+    c->next->prev = c->prev;
+    ev_io_del(p->loop, &c->io);
+    free(c);
+}
+
+/**
+ * @brief Peek at a connection without consuming anything.
+ *
+ * @return ssize_t 1 if data is queued, 0 if the peer closed, -1 if nothing happened.
+ */
+static ssize_t conn_peek(int fd) {
+    char byte;
+    ssize_t n = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        return 0;  // Reset
+    }
+    return n;
+}
+
+/**
+ * @brief A connect completed, or an idle connection was closed by its peer.
+ */
+static void on_pool_io(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct pool_conn *c = io->arg;
+    struct conn_pool *p = c->pool;
+    int fd = c->fd;
+
+    if (c->connected) {
+        conn_unlink(c);
+        close(fd);
+        return;
+    }
+
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+        conn_unlink(c);
+        close(fd);
+        report(p, err);
+        return;
+    }
+    c->connected = 1;
+    p->nconnecting--;
+    p->nidle++;
+    ev_io_mod(loop, &c->io, EPOLLRDHUP);
+    report(p, 0);
+}
+
+/**
+ * @brief Add a connection to the pool and watch it.
+ *
+ * @return int 0 on success, -1 if it could not be registered.
+ */
+static int conn_add(struct conn_pool *p, int fd, int connected) {
+    struct pool_conn *c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        return -1;
+    }
+    c->fd = fd;
+    c->connected = connected;
+    c->pool = p;
+    if (ev_io_add(p->loop, &c->io, fd, connected ? EPOLLRDHUP : EPOLLOUT, on_pool_io, c) == -1) {
+        free(c);
+        return -1;
+    }
+    c->next = &p->conns;
+    c->prev = p->conns.prev;
+    p->conns.prev->next = c;
+    p->conns.prev = c;
+    if (connected) {
+        p->nidle++;
+    } else {
+        p->nconnecting++;
+    }
+    return 0;
+}
+
+void pool_fill(struct conn_pool *p, struct evloop *loop) {
+    p->loop = loop;
+    while (p->nidle + p->nconnecting < p->min_idle) {
+        int fd = socket(p->addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            return;
+        }
+        int connected = connect(fd, p->addr, p->addrlen) == 0;
+        if (!connected && errno != EINPROGRESS) {
+            int err = errno;
+            close(fd);
+            if (err != EAGAIN) {  // A Unix listener with a full backlog is busy, not down
+                report(p, err);
+            }
+            return;
+        }
+        if (conn_add(p, fd, connected) == -1) {
+            close(fd);
+            return;
+        }
+        if (connected) {
+            report(p, 0);
+        }
+    }
+}
+
+int pool_lease(struct conn_pool *p) {
+    struct pool_conn *c = p->conns.next;
+    while (c != &p->conns) {
+        struct pool_conn *next = c->next;
+        if (c->connected) {
+            int fd = c->fd;
+            conn_unlink(c);
+            if (conn_peek(fd) != 0) {  // A greeting of a server that speaks first is kept for the session
+                p->hits++;
+                pool_fill(p, p->loop);
+                return fd;
+            }
+            close(fd);  // Closed by the target in this loop iteration
+        }
+        c = next;
+    }
+    if (p->max_idle > 0) {
+        p->misses++;
+        if (p->loop != NULL) {
+            pool_fill(p, p->loop);
+        }
+    }
+    return -1;
+}
+
+void pool_return(struct conn_pool *p, int fd) {
+    if (p->loop == NULL || p->nidle >= p->max_idle || conn_peek(fd) != -1 || conn_add(p, fd, 1) == -1) {
+        close(fd);
+        return;
+    }
+    p->reused++;
+}
+
+void pool_close(struct conn_pool *p) {
+    while (p->conns.next != &p->conns) {
+        int fd = p->conns.next->fd;
+        conn_unlink(p->conns.next);
+        close(fd);
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <sys/socket.h>
+
+#include "evloop.h"
+
+struct conn_pool;
+
+/**
+ * @brief A pooled outbound connection, connecting or idle.
+ */
+struct pool_conn {
+    int fd;
+    int connected;
+    struct ev_io io;   // EPOLLOUT while connecting, then EPOLLRDHUP to notice a peer close
+    struct conn_pool *pool;
+    struct pool_conn *next;
+    struct pool_conn *prev;
+};
+
+/**
+ * @brief Pre-established connections to one target.
+ *
+ * Idle connections stay registered with the loop, so one the target closes
+ * is dropped at once instead of being leased. Data the target sends first
+ * stays queued for the session that leases the connection. Every
+ * connect result is reported through on_result, which lets the owner track
+ * the target's health.
+ */
+struct conn_pool {
+    const struct sockaddr *addr;
+    socklen_t addrlen;
+    int min_idle;       // Connections kept ready, refilled after every lease
+    int max_idle;       // Returned connections kept at most, 0 disables the pool
+    int nidle;
+    int nconnecting;
+    struct pool_conn conns;  // Sentinel of the connection list
+    struct evloop *loop;
+    void (*on_result)(void *arg, int err);  // err is 0 after a successful connect
+    void *arg;
+    unsigned long hits;      // Leases served by an idle connection
+    unsigned long misses;    // Leases that found none
+    unsigned long reused;    // Connections returned to the pool
+};
+
+/**
+ * @brief Initialize an empty, disabled pool.
+ *
+ * @param p Pool, which must not move afterwards.
+ * @param addr Target address, kept by reference.
+ * @param addrlen Length of addr.
+ * @param on_result Connect result callback, or NULL.
+ * @param arg Argument of on_result.
+ */
+void pool_init(struct conn_pool *p, const struct sockaddr *addr, socklen_t addrlen,
+               void (*on_result)(void *arg, int err), void *arg);
+
+/**
+ * @brief Open connections until min_idle are idle or connecting.
+ *
+ * Stops at the first connect that fails right away, leaving further
+ * attempts to the next fill.
+ *
+ * @param p Pool.
+ * @param loop Event loop watching the connections.
+ */
+void pool_fill(struct conn_pool *p, struct evloop *loop);
+
+/**
+ * @brief Take an established connection out of the pool.
+ *
+ * @param p Pool.
+ * @return int A connected non-blocking socket, or -1 if none is idle.
+ */
+int pool_lease(struct conn_pool *p);
+
+/**
+ * @brief Give a leased connection back, or close it if the pool is full.
+ *
+ * @param p Pool.
+ * @param fd Connection that carries no unfinished exchange. One with unread
+ *           data or closed by its peer is closed instead.
+ */
+void pool_return(struct conn_pool *p, int fd);
+
+/**
+ * @brief Close every pooled connection.
+ */
+void pool_close(struct conn_pool *p);
+
+#endif
@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+
+#include "record.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+uint64_t rec_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int recorder_open(struct recorder *rec, const char *path) {
+    rec->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (rec->fd == -1) {
+        return -1;
+    }
+
+    rec->size = REC_INITIAL_SIZE;
+    if (ftruncate(rec->fd, rec->size) == -1) {
+        close(rec->fd);
+        return -1;
+    }
+    rec->map = mmap(NULL, rec->size, PROT_READ | PROT_WRITE, MAP_SHARED, rec->fd, 0);
+    if (rec->map == MAP_FAILED) {
+        close(rec->fd);
+        return -1;
+    }
+
+    memcpy(rec->map, REC_MAGIC, REC_MAGIC_LEN);
+    rec->used = REC_MAGIC_LEN;
+    return 0;
+}
+
+/**
+ * @brief Grow the file and its mapping until need more bytes fit.
+ *
+ * @param rec Open recorder.
+ * @param need Bytes about to be appended.
+ * @return int 0 on success, -1 on failure.
+ */
+static int recorder_reserve(struct recorder *rec, size_t need) {
+    size_t size = rec->size;
+    while (rec->used + need > size) {
+        size *= 2;
+    }
+    if (size == rec->size) {
+        return 0;
+    }
+
+    if (ftruncate(rec->fd, size) == -1) {
+        return -1;
+    }
+    char *map = mremap(rec->map, rec->size, size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    rec->map = map;
+    rec->size = size;
+    return 0;
+}
+
+int recorder_write(struct recorder *rec, int dir, const void *data, size_t len) {
+    if (recorder_reserve(rec, sizeof(struct rec_header) + len) == -1) {
+        return -1;
+    }
+
+    struct rec_header hdr = {.ts_ns = rec_now_ns(), .len = len, .dir = dir};
+    memcpy(rec->map + rec->used, &hdr, sizeof(hdr));
+    memcpy(rec->map + rec->used + sizeof(hdr), data, len);
+    rec->used += sizeof(hdr) + len;
+    return 0;
+}
+
+void recorder_close(struct recorder *rec) {
+    munmap(rec->map, rec->size);
+    ftruncate(rec->fd, rec->used);  // On failure readers stop at the zeroed tail
+    close(rec->fd);
+}
+
+int rec_reader_open(struct rec_reader *reader, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < REC_MAGIC_LEN) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    reader->size = st.st_size;
+    reader->map = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (reader->map == MAP_FAILED) {
+        return -1;
+    }
+    if (memcmp(reader->map, REC_MAGIC, REC_MAGIC_LEN) != 0) {
+        munmap(reader->map, reader->size);
+        errno = EINVAL;
+        return -1;
+    }
+    reader->pos = REC_MAGIC_LEN;
+    return 0;
+}
+
+int rec_reader_next(struct rec_reader *reader, struct rec_header *hdr, const char **payload) {
+    if (reader->pos + sizeof(*hdr) > reader->size) {
+        return 0;
+    }
+    memcpy(hdr, reader->map + reader->pos, sizeof(*hdr));
+
+    // A zero header is the unused tail of a capture that was not closed cleanly
+    if (hdr->ts_ns == 0 && hdr->len == 0) {
+        return 0;
+    }
+    if (reader->pos + sizeof(*hdr) + hdr->len > reader->size) {
+        return -1;
+    }
+    *payload = reader->map + reader->pos + sizeof(*hdr);
+    reader->pos += sizeof(*hdr) + hdr->len;
+    return 1;
+}
+
+void rec_reader_close(struct rec_reader *reader) {
+    munmap(reader->map, reader->size);
+}
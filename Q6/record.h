@@ -0,0 +1,109 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REC_MAGIC "MYNCREC1"        // 8 byte file signature
+#define REC_MAGIC_LEN 8
+#define REC_INITIAL_SIZE (1 << 20)  // First mapping size of a capture file
+
+#define REC_DIR_IN 0   // Chunk travelling towards the program / output endpoint
+#define REC_DIR_OUT 1  // Chunk travelling back towards the peer
+
+/**
+ * @brief Header preceding every recorded chunk.
+ *
+ * A capture file is REC_MAGIC followed by packed records, each this header
+ * and len payload bytes. Fields are stored in host byte order; timestamps are
+ * CLOCK_MONOTONIC nanoseconds, only their differences are meaningful.
+ */
+struct rec_header {
+    uint64_t ts_ns;
+    uint32_t len;
+    uint8_t dir;
+} __attribute__((packed));
+
+/**
+ * @brief Appends records to a memory-mapped capture file.
+ *
+ * Records are copied straight into a shared mapping that grows by doubling,
+ * so capturing a chunk costs a memcpy and no system call.
+ */
+struct recorder {
+    int fd;
+    char *map;
+    size_t size;   // Size of the mapping and of the file while open
+    size_t used;   // Bytes written so far
+};
+
+/**
+ * @brief Sequential reader over a memory-mapped capture file.
+ */
+struct rec_reader {
+    char *map;
+    size_t size;
+    size_t pos;
+};
+
+/**
+ * @brief Current CLOCK_MONOTONIC time in nanoseconds.
+ *
+ * @return uint64_t Nanoseconds since an arbitrary fixed point.
+ */
+uint64_t rec_now_ns(void);
+
+/**
+ * @brief Create (or truncate) a capture file and map it for appending.
+ *
+ * @param rec Recorder to initialize.
+ * @param path Path of the capture file.
+ * @return int 0 on success, -1 on failure with errno set.
+ */
+int recorder_open(struct recorder *rec, const char *path);
+
+/**
+ * @brief Append a timestamped chunk.
+ *
+ * @param rec Open recorder.
+ * @param dir REC_DIR_IN or REC_DIR_OUT.
+ * @param data Chunk payload.
+ * @param len Payload length.
+ * @return int 0 on success, -1 if the file could not grow.
+ */
+int recorder_write(struct recorder *rec, int dir, const void *data, size_t len);
+
+/**
+ * @brief Unmap the capture file and trim it to the bytes written.
+ *
+ * @param rec Open recorder.
+ */
+void recorder_close(struct recorder *rec);
+
+/**
+ * @brief Map a capture file for reading and validate its signature.
+ *
+ * @param reader Reader to initialize.
+ * @param path Path of the capture file.
+ * @return int 0 on success, -1 on failure (errno is EINVAL for a bad file).
+ */
+int rec_reader_open(struct rec_reader *reader, const char *path);
+
+/**
+ * @brief Return the next record of a capture file.
+ *
+ * @param reader Open reader.
+ * @param hdr Receives the record header.
+ * @param payload Receives a pointer to the payload inside the mapping.
+ * @return int 1 for a record, 0 at the end, -1 for a truncated record.
+ */
+int rec_reader_next(struct rec_reader *reader, struct rec_header *hdr, const char **payload);
+
+/**
+ * @brief Unmap a capture file.
+ *
+ * @param reader Open reader.
+ */
+void rec_reader_close(struct rec_reader *reader);
+
+#endif
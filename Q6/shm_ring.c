@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+
+#include "shm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int futex_wait(_Atomic uint32_t *word, uint32_t expected, long ms) {
+    struct timespec ts = {ms / 1000, ms % 1000 * 1000000L};
+    return syscall(SYS_futex, word, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * @brief Check whether a process exists and has not exited.
+ *
+ * A zombie still answers kill(pid, 0) until its parent reaps it, so its
+ * state in /proc is checked as well.
+ */
+static int pid_alive(pid_t pid) {
+    if (pid == 0) {
+        return 1;
+    }
+    if (kill(pid, 0) == -1 && errno != EPERM) {
+        return 0;
+    }
+
+    char path[64], stat[256];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 1;
+    }
+    size_t n = fread(stat, 1, sizeof(stat) - 1, f);
+    fclose(f);
+    stat[n] = '\0';
+    char *state = strrchr(stat, ')');  // The command name may contain spaces
+    return state == NULL || state[1] != ' ' || state[2] != 'Z';
+}
+
+/**
+ * @brief Check that the process on the other side still exists.
+ *
+ * A peer that was killed never sets eof or gone, so waits poll this
+ * between futex sleeps and treat a dead peer as a closed channel.
+ */
+static int peer_alive(struct shm_endpoint *ep) {
+    return pid_alive(atomic_load(&ep->hdr->pids[1 - ep->role]));
+}
+
+/**
+ * @brief Idle once while waiting for *word to move away from seen.
+ *
+ * The first SHM_SPIN polls (all of them with spin set) only pause the CPU.
+ * After that the waiter announces itself through *waiting and sleeps on the
+ * futex; the other side checks the flag after publishing, so neither side
+ * makes a system call while the ring is busy.
+ *
+ * @return int 0 to poll again, -1 if the peer died.
+ */
+static int ring_idle(struct shm_endpoint *ep, _Atomic uint32_t *word, _Atomic uint32_t *waiting, uint32_t seen,
+                     unsigned polls) {
+    if (ep->spin || polls < SHM_SPIN) {
+        cpu_relax();
+        if (ep->spin && polls % (1u << 20) == (1u << 20) - 1) {
+            return peer_alive(ep) ? 0 : -1;
+        }
+        return 0;
+    }
+
+    atomic_store(waiting, 1);
+    if (atomic_load(word) == seen && !atomic_load(&ep->stop)) {
+        if (futex_wait(word, seen, SHM_WAIT_MS) == -1 && errno == ETIMEDOUT && !peer_alive(ep)) {
+            atomic_store(waiting, 0);
+            return -1;
+        }
+    }
+    atomic_store(waiting, 0);
+    return 0;
+}
+
+/**
+ * @brief Wake the other side if it sleeps on a word just published.
+ */
+static void ring_publish(_Atomic uint32_t *waiting, _Atomic uint32_t *word) {
+    atomic_thread_fence(memory_order_seq_cst);  // Order the publish before reading the flag
+    if (atomic_load_explicit(waiting, memory_order_relaxed)) {
+        futex_wake(word);
+    }
+}
+
+/**
+ * @brief Join an existing segment as role 1.
+ *
+ * @return int 0 on success, 1 if the segment is stale and was unlinked, -1 on error.
+ */
+static int shm_join(struct shm_endpoint *ep, int fd) {
+    struct stat st;
+    long long give_up = now_ms() + 1000;  // The creator sizes and initializes right after creating
+
+    while (fstat(fd, &st) == 0 && (size_t)st.st_size < ep->map_len && now_ms() < give_up) {
+        usleep(1000);
+    }
+    if ((size_t)st.st_size < ep->map_len) {
+        shm_unlink(ep->path);
+        return 1;
+    }
+    ep->hdr = mmap(NULL, ep->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ep->hdr == MAP_FAILED) {
+        return -1;
+    }
+    while (atomic_load_explicit(&ep->hdr->magic, memory_order_acquire) != SHM_MAGIC && now_ms() < give_up) {
+        usleep(1000);
+    }
+
+    pid_t none = 0;
+    if (atomic_load_explicit(&ep->hdr->magic, memory_order_acquire) != SHM_MAGIC ||
+        ep->hdr->size != SHM_RING_SIZE || !pid_alive(atomic_load(&ep->hdr->pids[0]))) {
+        munmap(ep->hdr, ep->map_len);
+        shm_unlink(ep->path);
+        return 1;
+    }
+    if (!atomic_compare_exchange_strong(&ep->hdr->pids[1], &none, getpid())) {
+        munmap(ep->hdr, ep->map_len);
+        if (pid_alive(none)) {
+            errno = EBUSY;
+            return -1;
+        }
+        shm_unlink(ep->path);
+        return 1;
+    }
+
+    atomic_fetch_add(&ep->hdr->users, 1);
+    atomic_fetch_add(&ep->hdr->joined, 1);
+    futex_wake(&ep->hdr->joined);
+    ep->role = 1;
+    return 0;
+}
+
+int shm_endpoint_open(struct shm_endpoint *ep, const char *name, int spin, long long timeout_ms) {
+    memset(ep, 0, sizeof(*ep));
+    if (strchr(name, '/') != NULL || snprintf(ep->path, sizeof(ep->path), "/mync-%s", name) >= (int)sizeof(ep->path)) {
+        errno = EINVAL;
+        return -1;
+    }
+    ep->spin = spin;
+    ep->map_len = SHM_DATA_OFFSET + 2 * (size_t)SHM_RING_SIZE;
+    long long deadline = timeout_ms >= 0 ? now_ms() + timeout_ms : -1;
+
+    for (;;) {
+        int fd = shm_open(ep->path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd >= 0) {
+            if (ftruncate(fd, ep->map_len) == -1 ||
+                (ep->hdr = mmap(NULL, ep->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+                int saved = errno;
+                close(fd);
+                shm_unlink(ep->path);
+                errno = saved;
+                return -1;
+            }
+            close(fd);
+            ep->hdr->size = SHM_RING_SIZE;
+            atomic_store(&ep->hdr->pids[0], getpid());
+            atomic_store(&ep->hdr->joined, 1);
+            atomic_store(&ep->hdr->users, 1);
+            atomic_store_explicit(&ep->hdr->magic, SHM_MAGIC, memory_order_release);
+            ep->role = 0;
+            break;
+        }
+        if (errno != EEXIST) {
+            return -1;
+        }
+
+        fd = shm_open(ep->path, O_RDWR | O_CLOEXEC, 0);
+        if (fd == -1) {
+            if (errno == ENOENT) {
+                continue;  // Unlinked meanwhile, create it
+            }
+            return -1;
+        }
+        int ret = shm_join(ep, fd);
+        close(fd);
+        if (ret == -1) {
+            return -1;
+        }
+        if (ret == 0) {
+            break;
+        }
+    }
+
+    // Rendezvous: the creator waits here until the other side joins
+    uint32_t joined;
+    while ((joined = atomic_load(&ep->hdr->joined)) < 2) {
+        long long wait = SHM_WAIT_MS;
+        if (deadline >= 0) {
+            long long left = deadline - now_ms();
+            if (left <= 0) {
+                shm_endpoint_close(ep);
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            wait = left < wait ? left : wait;
+        }
+        futex_wait(&ep->hdr->joined, joined, wait);
+    }
+
+    char *data = (char *)ep->hdr + SHM_DATA_OFFSET;
+    ep->tx = &ep->hdr->rings[ep->role];
+    ep->rx = &ep->hdr->rings[1 - ep->role];
+    ep->tx_data = data + (size_t)ep->role * ep->hdr->size;
+    ep->rx_data = data + (size_t)(1 - ep->role) * ep->hdr->size;
+    return 0;
+}
+
+void *shm_write_span(struct shm_endpoint *ep, size_t *len) {
+    struct shm_ring *r = ep->tx;
+    uint32_t size = ep->hdr->size;
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    for (unsigned polls = 0; !atomic_load_explicit(&r->gone, memory_order_acquire); polls++) {
+        uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        uint32_t space = size - (head - tail);
+        if (space > 0) {
+            uint32_t off = head & (size - 1);
+            *len = space < size - off ? space : size - off;
+            return ep->tx_data + off;
+        }
+        if (atomic_load(&ep->stop) || ring_idle(ep, &r->tail, &r->producer_waiting, tail, polls) == -1) {
+            break;
+        }
+    }
+    *len = 0;
+    return NULL;
+}
+
+void shm_write_commit(struct shm_endpoint *ep, size_t len) {
+    struct shm_ring *r = ep->tx;
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, head + (uint32_t)len, memory_order_release);
+    ring_publish(&r->consumer_waiting, &r->head);
+}
+
+ssize_t shm_write(struct shm_endpoint *ep, const void *data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        size_t span;
+        char *p = shm_write_span(ep, &span);
+        if (p == NULL) {
+            return -1;
+        }
+        if (span > len - done) {
+            span = len - done;
+        }
+        memcpy(p, (const char *)data + done, span);
+        shm_write_commit(ep, span);
+        done += span;
+    }
+    return len;
+}
+
+void *shm_read_span(struct shm_endpoint *ep, size_t *len) {
+    struct shm_ring *r = ep->rx;
+    uint32_t size = ep->hdr->size;
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    for (unsigned polls = 0;; polls++) {
+        uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (head != tail) {
+            uint32_t off = tail & (size - 1);
+            uint32_t avail = head - tail;
+            *len = avail < size - off ? avail : size - off;
+            return ep->rx_data + off;
+        }
+        if (atomic_load_explicit(&r->eof, memory_order_acquire)) {
+            if (atomic_load_explicit(&r->head, memory_order_acquire) != tail) {
+                continue;  // Published just before eof
+            }
+            break;
+        }
+        if (atomic_load(&ep->stop) || ring_idle(ep, &r->head, &r->consumer_waiting, head, polls) == -1) {
+            break;
+        }
+    }
+    *len = 0;
+    return NULL;
+}
+
+void shm_read_release(struct shm_endpoint *ep, size_t len) {
+    struct shm_ring *r = ep->rx;
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, tail + (uint32_t)len, memory_order_release);
+    ring_publish(&r->producer_waiting, &r->tail);
+}
+
+ssize_t shm_read(struct shm_endpoint *ep, void *buffer, size_t len) {
+    size_t span;
+    char *p = shm_read_span(ep, &span);
+    if (p == NULL) {
+        return 0;
+    }
+    if (span > len) {
+        span = len;
+    }
+    memcpy(buffer, p, span);
+    shm_read_release(ep, span);
+    return span;
+}
+
+void shm_close_write(struct shm_endpoint *ep) {
+    atomic_store_explicit(&ep->tx->eof, 1, memory_order_release);
+    futex_wake(&ep->tx->head);
+}
+
+void shm_close_read(struct shm_endpoint *ep) {
+    atomic_store_explicit(&ep->rx->gone, 1, memory_order_release);
+    futex_wake(&ep->rx->tail);
+}
+
+void shm_endpoint_shutdown(struct shm_endpoint *ep) {
+    atomic_store(&ep->stop, 1);
+    futex_wake(&ep->rx->head);  // This side's own sleepers
+    futex_wake(&ep->tx->tail);
+}
+
+void shm_endpoint_close(struct shm_endpoint *ep) {
+    if (atomic_load(&ep->hdr->joined) >= 2) {
+        shm_close_write(ep);
+        shm_close_read(ep);
+    }
+    if (atomic_fetch_sub(&ep->hdr->users, 1) == 1) {
+        shm_unlink(ep->path);
+    }
+    munmap(ep->hdr, ep->map_len);
+}
@@ -0,0 +1,150 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_MAGIC 0x4d594e43u          // "MYNC", set once the creator has initialized the segment
+#define SHM_RING_SIZE (1u << 20)       // Data bytes of each direction, a power of two
+#define SHM_DATA_OFFSET 4096           // Ring data starts on the page after the header
+#define SHM_SPIN 2048                  // Polls of an idle ring before sleeping on its futex
+#define SHM_WAIT_MS 100                // Futex sleep between checks that the peer is alive
+
+/**
+ * @brief One direction of a shared-memory channel: a lock-free SPSC ring.
+ *
+ * head and tail count bytes ever written and read; they wrap at 2^32, which
+ * is harmless since the ring size is a smaller power of two. Each is written
+ * by one side only and is also the futex word the other side sleeps on, so
+ * the fast path is plain loads and stores: a futex wake is only issued when
+ * the other side has announced it is asleep.
+ */
+struct shm_ring {
+    _Atomic uint32_t head __attribute__((aligned(64)));  // Producer's position, consumer sleeps on it
+    _Atomic uint32_t consumer_waiting;
+    _Atomic uint32_t eof;                                // Producer is done
+    _Atomic uint32_t tail __attribute__((aligned(64)));  // Consumer's position, producer sleeps on it
+    _Atomic uint32_t producer_waiting;
+    _Atomic uint32_t gone;                               // Consumer is done
+};
+
+/**
+ * @brief Header of a shared-memory channel, at offset 0 of the segment.
+ *
+ * The segment is named "/mync-<name>" (see shm_open(3)) and holds two rings.
+ * The side that creates it takes role 0 and the side that joins role 1; a
+ * side always writes rings[role] and reads rings[1 - role], so a -b endpoint
+ * pairs with a -b endpoint and -o pairs with -i.
+ */
+struct shm_header {
+    _Atomic uint32_t magic;
+    uint32_t size;              // Data bytes of each ring
+    _Atomic uint32_t joined;    // Sides that joined so far, futex word of the rendezvous
+    _Atomic uint32_t users;     // Sides still attached; the last one unlinks the segment
+    _Atomic pid_t pids[2];      // Process of each role, to detect a peer that died
+    struct shm_ring rings[2];
+};
+
+/**
+ * @brief One side of a shared-memory channel.
+ */
+struct shm_endpoint {
+    struct shm_header *hdr;
+    size_t map_len;
+    int role;
+    int spin;                   // Never sleep: poll idle rings until data arrives
+    _Atomic int stop;           // Set by shm_endpoint_shutdown()
+    struct shm_ring *tx;
+    struct shm_ring *rx;
+    char *tx_data;
+    char *rx_data;
+    char path[NAME_MAX];
+};
+
+/**
+ * @brief Create or join the channel <name> and wait for the other side.
+ *
+ * Like a FIFO, the call returns once both sides are attached. A segment
+ * left behind by a process that died is discarded and created afresh.
+ *
+ * @param ep Endpoint to initialize.
+ * @param name Channel name, without the leading slash.
+ * @param spin Non-zero to busy-poll instead of sleeping when a ring is idle.
+ * @param timeout_ms Longest wait for the other side, -1 for no limit.
+ * @return int 0 on success, -1 with errno set (ETIMEDOUT, EBUSY if both roles are taken).
+ */
+int shm_endpoint_open(struct shm_endpoint *ep, const char *name, int spin, long long timeout_ms);
+
+/**
+ * @brief Wait for free space in the outgoing ring.
+ *
+ * The caller writes up to *len bytes at the returned address and publishes
+ * them with shm_write_commit(). The span never wraps, so it can be handed
+ * directly to read(2).
+ *
+ * @param ep Endpoint.
+ * @param len Set to the contiguous free bytes.
+ * @return void* Start of the free span, NULL once the reader is gone.
+ */
+void *shm_write_span(struct shm_endpoint *ep, size_t *len);
+
+/**
+ * @brief Publish bytes written into the span from shm_write_span().
+ */
+void shm_write_commit(struct shm_endpoint *ep, size_t len);
+
+/**
+ * @brief Copy a buffer into the outgoing ring, waiting for space as needed.
+ *
+ * @return ssize_t len, or -1 once the reader is gone.
+ */
+ssize_t shm_write(struct shm_endpoint *ep, const void *data, size_t len);
+
+/**
+ * @brief Wait for data in the incoming ring.
+ *
+ * The caller consumes up to *len bytes at the returned address and frees
+ * them with shm_read_release().
+ *
+ * @param ep Endpoint.
+ * @param len Set to the contiguous readable bytes.
+ * @return void* Start of the data, NULL at end of stream.
+ */
+void *shm_read_span(struct shm_endpoint *ep, size_t *len);
+
+/**
+ * @brief Release bytes consumed from the span from shm_read_span().
+ */
+void shm_read_release(struct shm_endpoint *ep, size_t len);
+
+/**
+ * @brief Copy up to len bytes out of the incoming ring, waiting for data.
+ *
+ * @return ssize_t Bytes read, 0 at end of stream.
+ */
+ssize_t shm_read(struct shm_endpoint *ep, void *buffer, size_t len);
+
+/**
+ * @brief Signal end of stream on the outgoing ring.
+ */
+void shm_close_write(struct shm_endpoint *ep);
+
+/**
+ * @brief Tell the other side nothing more will be read.
+ */
+void shm_close_read(struct shm_endpoint *ep);
+
+/**
+ * @brief Make every wait on the endpoint return, from any thread.
+ */
+void shm_endpoint_shutdown(struct shm_endpoint *ep);
+
+/**
+ * @brief Close both directions and detach; the last side unlinks the segment.
+ */
+void shm_endpoint_close(struct shm_endpoint *ep);
+
+#endif
@@ -0,0 +1,211 @@
+#define _GNU_SOURCE
+
+#include "sockmap.h"
+
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/sockios.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int bpf(int cmd, union bpf_attr *attr) {
+    return syscall(SYS_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int map_create(enum bpf_map_type type, uint32_t value_size) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = type;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = value_size;
+    attr.max_entries = 1;
+    return bpf(BPF_MAP_CREATE, &attr);
+}
+
+static int map_update(int map, uint32_t key, const void *value) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map;
+    attr.key = (uintptr_t)&key;
+    attr.value = (uintptr_t)value;
+    attr.flags = BPF_ANY;
+    return bpf(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+static int map_lookup(int map, uint32_t key, void *value) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map;
+    attr.key = (uintptr_t)&key;
+    attr.value = (uintptr_t)value;
+    return bpf(BPF_MAP_LOOKUP_ELEM, &attr);
+}
+
+static void map_delete(int map, uint32_t key) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map;
+    attr.key = (uintptr_t)&key;
+    bpf(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+static struct bpf_insn insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+    return (struct bpf_insn){.code = code, .dst_reg = dst, .src_reg = src, .off = off, .imm = imm};
+}
+
+/**
+ * @brief Load the sk_skb verdict program.
+ *
+ * Equivalent C, with stats a one-entry array of {chunks, bytes}:
+ *
+ *     __u64 *s = bpf_map_lookup_elem(&stats, &zero);
+ *     if (s) { __sync_fetch_and_add(&s[0], 1); __sync_fetch_and_add(&s[1], skb->len); }
+ *     return bpf_sk_redirect_map(skb, &dst, 0, 0);
+ */
+static int load_verdict(int stats_map, int dst_map) {
+    struct bpf_insn prog[] = {
+        insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+        insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_7, BPF_REG_6, offsetof(struct __sk_buff, len), 0),
+        insn(BPF_ST | BPF_MEM | BPF_W, BPF_REG_10, 0, -4, 0),
+        insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0),
+        insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -4),
+        insn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, stats_map),
+        insn(0, 0, 0, 0, 0),
+        insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+        insn(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 3, 0),
+        insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_1, 0, 0, 1),
+        insn(BPF_STX | BPF_ATOMIC | BPF_DW, BPF_REG_0, BPF_REG_1, 0, BPF_ADD),
+        insn(BPF_STX | BPF_ATOMIC | BPF_DW, BPF_REG_0, BPF_REG_7, 8, BPF_ADD),
+        insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0),
+        insn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_2, BPF_PSEUDO_MAP_FD, 0, dst_map),
+        insn(0, 0, 0, 0, 0),
+        insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, 0),
+        insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, 0),
+        insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_sk_redirect_map),
+        insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_SK_SKB;
+    attr.insns = (uintptr_t)prog;
+    attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+    attr.license = (uintptr_t) "GPL";
+    return bpf(BPF_PROG_LOAD, &attr);
+}
+
+static int attach(int prog, int map, enum bpf_attach_type type) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.target_fd = map;
+    attr.attach_bpf_fd = prog;
+    attr.attach_type = type;
+    return bpf(BPF_PROG_ATTACH, &attr);
+}
+
+static int is_tcp(int fd) {
+    int domain, protocol;
+    socklen_t len = sizeof(int);
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &len) == -1 ||
+        getsockopt(fd, SOL_SOCKET, SO_PROTOCOL, &protocol, &len) == -1) {
+        return 0;
+    }
+    return (domain == AF_INET || domain == AF_INET6) && protocol == IPPROTO_TCP;
+}
+
+/**
+ * @brief Bytes ever written to a TCP socket: acknowledged plus still queued.
+ */
+static uint64_t tcp_written(int fd) {
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    int queued = 0;
+    memset(&info, 0, sizeof(info));
+    getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+    ioctl(fd, SIOCOUTQ, &queued);
+    return info.tcpi_bytes_acked + queued;
+}
+
+static void close_objects(struct sockmap_relay *r) {
+    int fds[] = {r->prog, r->src_map, r->dst_map, r->stats_map};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+}
+
+int sockmap_relay_start(struct sockmap_relay *r, int from_fd, int to_fd) {
+    int pending = 0;
+    r->from_fd = from_fd;
+    r->to_fd = to_fd;
+    r->prog = -1;
+
+    if (!is_tcp(from_fd) || !is_tcp(to_fd)) {
+        errno = EPROTONOSUPPORT;
+        r->src_map = r->dst_map = r->stats_map = -1;
+        return -1;
+    }
+
+    r->src_map = map_create(BPF_MAP_TYPE_SOCKMAP, sizeof(uint32_t));
+    r->dst_map = map_create(BPF_MAP_TYPE_SOCKMAP, sizeof(uint32_t));
+    r->stats_map = map_create(BPF_MAP_TYPE_ARRAY, 2 * sizeof(uint64_t));
+    if (r->src_map < 0 || r->dst_map < 0 || r->stats_map < 0) {
+        goto fail;
+    }
+    r->prog = load_verdict(r->stats_map, r->dst_map);
+    if (r->prog < 0 || attach(r->prog, r->src_map, BPF_SK_SKB_VERDICT) == -1) {
+        goto fail;
+    }
+
+    uint32_t fd = to_fd;
+    r->base = tcp_written(to_fd);
+    if (map_update(r->dst_map, 0, &fd) == -1) {
+        goto fail;
+    }
+    fd = from_fd;
+    if (map_update(r->src_map, 0, &fd) == -1) {
+        map_delete(r->dst_map, 0);
+        goto fail;
+    }
+
+    // Bytes queued before the verdict program took over would wait for the
+    // next segment; leave such a session to the userspace relay instead.
+    if (ioctl(from_fd, FIONREAD, &pending) == 0 && pending > 0) {
+        map_delete(r->src_map, 0);
+        map_delete(r->dst_map, 0);
+        errno = EAGAIN;
+        goto fail;
+    }
+    return 0;
+
+fail:;
+    int saved = errno;
+    close_objects(r);
+    errno = saved;
+    return -1;
+}
+
+void sockmap_relay_stats(struct sockmap_relay *r, uint64_t *chunks, uint64_t *bytes) {
+    uint64_t value[2] = {0, 0};
+    map_lookup(r->stats_map, 0, value);
+    *chunks = value[0];
+    *bytes = value[1];
+}
+
+int sockmap_relay_flushed(struct sockmap_relay *r) {
+    uint64_t chunks, bytes;
+    sockmap_relay_stats(r, &chunks, &bytes);
+    return tcp_written(r->to_fd) - r->base >= bytes;
+}
+
+void sockmap_relay_stop(struct sockmap_relay *r) {
+    map_delete(r->src_map, 0);
+    map_delete(r->dst_map, 0);
+    close_objects(r);
+}
@@ -0,0 +1,60 @@
+#ifndef SOCKMAP_H
+#define SOCKMAP_H
+
+#include <stdint.h>
+
+/**
+ * @brief A kernel relay from one TCP socket to another through a BPF sockmap.
+ *
+ * The source socket is installed in a sockmap with an sk_skb verdict
+ * program that counts every chunk and redirects it to the destination
+ * socket, so the payload never reaches userspace. Only setup, teardown and
+ * the counters are left to mync.
+ */
+struct sockmap_relay {
+    int from_fd;
+    int to_fd;
+    int src_map;     // Holds from_fd; the verdict program is attached to it
+    int dst_map;     // Holds to_fd, the redirect target
+    int stats_map;   // Chunks and bytes seen by the verdict program
+    int prog;
+    uint64_t base;   // Bytes already written to to_fd before the relay started
+};
+
+/**
+ * @brief Start relaying from_fd to to_fd in the kernel.
+ *
+ * Fails without side effects on either socket when BPF is not permitted or
+ * not supported, or when the sockets are not connected TCP sockets, so the
+ * caller can relay in userspace instead.
+ *
+ * @param r Relay to initialize.
+ * @param from_fd Connected TCP socket read by the relay.
+ * @param to_fd Connected TCP socket written by the relay.
+ * @return int 0 on success, -1 with errno set.
+ */
+int sockmap_relay_start(struct sockmap_relay *r, int from_fd, int to_fd);
+
+/**
+ * @brief Read the verdict program's counters.
+ *
+ * @param r Running relay.
+ * @param chunks Set to the chunks redirected.
+ * @param bytes Set to the bytes redirected.
+ */
+void sockmap_relay_stats(struct sockmap_relay *r, uint64_t *chunks, uint64_t *bytes);
+
+/**
+ * @brief Check whether every redirected byte has been handed to to_fd.
+ *
+ * Redirected chunks are sent from a kernel work queue, so after the source
+ * reaches EOF this must hold before the destination is shut down.
+ */
+int sockmap_relay_flushed(struct sockmap_relay *r);
+
+/**
+ * @brief Take both sockets out of the relay and release its BPF objects.
+ */
+void sockmap_relay_stop(struct sockmap_relay *r);
+
+#endif
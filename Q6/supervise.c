@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+
+#include "supervise.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @brief Remove and return the child registered for a pid.
+ *
+ * @param reaper Reaper.
+ * @param pid Pid returned by waitpid().
+ * @return struct child* The child, or NULL if the pid is not supervised.
+ */
+static struct child *reaper_take(struct reaper *reaper, pid_t pid) {
+    for (struct child **p = &reaper->buckets[pid % REAPER_BUCKETS]; *p != NULL; p = &(*p)->next) {
+        if ((*p)->pid == pid) {
+            struct child *child = *p;
+            *p = child->next;
+            reaper->nchildren--;
+            return child;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief signalfd callback: reap every exited child and dispatch its status.
+ */
+static void on_sigchld(struct evloop *loop, struct ev_io *io, uint32_t events) {
+    struct reaper *reaper = io->arg;
+    struct signalfd_siginfo info;
+
+    // SIGCHLD notifications coalesce, so the siginfo itself is not trusted
+    while (read(io->fd, &info, sizeof(info)) == sizeof(info)) {
+    }
+
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        struct child *child = reaper_take(reaper, pid);
+        if (child != NULL && child->on_exit != NULL) {
+            child->on_exit(loop, child, status);
+        }
+    }
+}
+
+int reaper_init(struct reaper *reaper, struct evloop *loop) {
+    memset(reaper, 0, sizeof(*reaper));
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, &reaper->old_mask) == -1) {
+        return -1;
+    }
+
+    reaper->sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (reaper->sfd == -1) {
+        sigprocmask(SIG_SETMASK, &reaper->old_mask, NULL);
+        return -1;
+    }
+    if (ev_io_add(loop, &reaper->io, reaper->sfd, EPOLLIN, on_sigchld, reaper) == -1) {
+        close(reaper->sfd);
+        sigprocmask(SIG_SETMASK, &reaper->old_mask, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+void reaper_close(struct reaper *reaper, struct evloop *loop) {
+    ev_io_del(loop, &reaper->io);
+    close(reaper->sfd);
+    sigprocmask(SIG_SETMASK, &reaper->old_mask, NULL);
+}
+
+void reaper_child_setup(struct reaper *reaper) {
+    sigprocmask(SIG_SETMASK, &reaper->old_mask, NULL);
+    if (reaper->child_cpus != NULL) {
+        sched_setaffinity(0, sizeof(*reaper->child_cpus), reaper->child_cpus);
+    }
+}
+
+pid_t reaper_spawn(struct reaper *reaper, struct child *child, char **args, int in_fd, int out_fd) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (pid == 0) {
+        reaper_child_setup(reaper);
+        if (in_fd != STDIN_FILENO && dup2(in_fd, STDIN_FILENO) == -1) {
+            perror("dup2 input failed");
+            exit(EXIT_FAILURE);
+        }
+        if (out_fd != STDOUT_FILENO && dup2(out_fd, STDOUT_FILENO) == -1) {
+            perror("dup2 output failed");
+            exit(EXIT_FAILURE);
+        }
+        execvp(args[0], args);  // Execute the command in the child process
+        perror("Execution failed");  // If execvp returns, it must have failed
+        exit(EXIT_FAILURE);
+    }
+
+    reaper_adopt(reaper, child, pid);
+    return pid;
+}
+
+void reaper_adopt(struct reaper *reaper, struct child *child, pid_t pid) {
+    child->pid = pid;
+    struct child **bucket = &reaper->buckets[pid % REAPER_BUCKETS];
+    child->next = *bucket;
+    *bucket = child;
+    reaper->nchildren++;
+}
+
+int exit_code(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,97 @@
+#ifndef SUPERVISE_H
+#define SUPERVISE_H
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/types.h>
+
+#include "evloop.h"
+
+#define REAPER_BUCKETS 256
+
+struct child;
+
+typedef void (*child_exit_cb)(struct evloop *loop, struct child *child, int status);
+
+/**
+ * @brief A supervised child process.
+ *
+ * Callers embed this structure in their per-session state; on_exit runs from
+ * the event loop with the raw wait status once the child has been reaped.
+ */
+struct child {
+    pid_t pid;
+    child_exit_cb on_exit;
+    void *arg;
+    struct child *next;
+};
+
+/**
+ * @brief Reaps children from inside an event loop without ever blocking it.
+ *
+ * SIGCHLD is blocked and consumed through a signalfd; every notification
+ * drains all exited children with waitpid(WNOHANG) and dispatches them by pid.
+ */
+struct reaper {
+    int sfd;
+    struct ev_io io;
+    sigset_t old_mask;
+    struct child *buckets[REAPER_BUCKETS];
+    int nchildren;
+    const cpu_set_t *child_cpus;  // Affinity given to children before exec, NULL to inherit the caller's
+};
+
+/**
+ * @brief Block SIGCHLD and register the reaper's signalfd with a loop.
+ *
+ * @param reaper Reaper to initialize.
+ * @param loop Event loop dispatching child exits.
+ * @return int 0 on success, -1 on failure with errno set.
+ */
+int reaper_init(struct reaper *reaper, struct evloop *loop);
+
+/**
+ * @brief Unregister the reaper and restore the previous signal mask.
+ *
+ * @param reaper Reaper to close.
+ * @param loop Event loop it was registered with.
+ */
+void reaper_close(struct reaper *reaper, struct evloop *loop);
+
+/**
+ * @brief Prepare a freshly forked child: restore the signal mask and set its CPU affinity.
+ *
+ * @param reaper Reaper that will supervise the child.
+ */
+void reaper_child_setup(struct reaper *reaper);
+
+/**
+ * @brief Fork and exec a command with the given standard streams.
+ *
+ * @param reaper Reaper that will report the child's exit.
+ * @param child Child record, registered while the process is alive.
+ * @param args NULL terminated argument vector.
+ * @param in_fd Descriptor to become the child's stdin.
+ * @param out_fd Descriptor to become the child's stdout.
+ * @return pid_t The child's pid, or -1 if fork failed.
+ */
+pid_t reaper_spawn(struct reaper *reaper, struct child *child, char **args, int in_fd, int out_fd);
+
+/**
+ * @brief Supervise a child the caller forked itself.
+ *
+ * @param reaper Reaper that will report the child's exit.
+ * @param child Child record, registered while the process is alive.
+ * @param pid Pid returned by fork().
+ */
+void reaper_adopt(struct reaper *reaper, struct child *child, pid_t pid);
+
+/**
+ * @brief Convert a wait status to a shell style exit code.
+ *
+ * @param status Status returned by waitpid().
+ * @return int The exit code, or 128 + signal number for killed children.
+ */
+int exit_code(int status);
+
+#endif
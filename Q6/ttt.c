@@ -1,95 +1,338 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#define BOARD_SIZE 9
+#include "ttt_core.h"
+#include "ttt_game.h"
+#include "ttt_index.h"
+#include "ttt_io.h"
+#include "tttn_core.h"
 
-void print_board(char* board) {
-    for (int i = 0; i < 3; ++i) {
-        printf(" %c | %c | %c \n", board[i * 3 + 0], board[i * 3 + 1], board[i * 3 + 2]);
-        if (i < 2) {
-            printf("---+---+---\n");
-        }
+#define BOARD_SIZE TTT_CELLS
+
+static struct ttt_out output = {.fd = STDOUT_FILENO};
+static struct ttt_in input = {.fd = STDIN_FILENO, .flush = &output};
+
+/**
+ * @brief One hosted game of multi-game mode, 16 bytes including padding.
+ */
+struct game {
+    struct ttt_strategy strategy;
+    struct ttt_board board;
+    uint8_t cursor;  // Strategy cursor, see ttt_pick()
+    uint8_t active;
+};
+
+/**
+ * @brief Flush pending output, registered with atexit() so every exit path writes it.
+ */
+void flush_output(void) {
+    ttt_out_flush(&output);
+}
+
+/**
+ * @brief Read the human's next move.
+ *
+ * @param ncells Number of cells on the board.
+ * @return int The move as typed (1 based), or 0 if the token is not a cell number or input ended.
+ */
+int read_move(int ncells) {
+    char tok[16];
+    if (ttt_in_token(&input, tok, sizeof(tok)) == -1) {
+        return 0;
     }
-    printf("\n");
+    return ttt_game_parse_move(tok, ncells);
 }
 
-int check_win(char* board, char player) {
-    const int WINNING_COMBOS[8][3] = {
-        {0, 1, 2}, {3, 4, 5}, {6, 7, 8}, // rows
-        {0, 3, 6}, {1, 4, 7}, {2, 5, 8}, // columns
-        {0, 4, 8}, {2, 4, 6}  // diagonals
-    };
-
-    for (int i = 0; i < 8; ++i) {
-        if (board[WINNING_COMBOS[i][0]] == player &&
-            board[WINNING_COMBOS[i][1]] == player &&
-            board[WINNING_COMBOS[i][2]] == player) {
-            return 1;
-        }
+/**
+ * @brief Print a strategy's outcome profile, from the index when available.
+ *
+ * @param strategy Strategy to describe.
+ * @param index_path Index file to map.
+ */
+void print_profile(const struct ttt_strategy *strategy, const char *index_path) {
+    struct ttt_index index;
+    struct ttt_index_entry entry;
+    const char *source = "index";
+
+    if (ttt_index_open(&index, index_path) == 0) {
+        entry = *ttt_index_lookup(&index, strategy);
+        ttt_index_close(&index);
+    } else {
+        struct ttt_outcome outcome;
+        ttt_evaluate(strategy, &outcome);
+        ttt_index_pack(&outcome, &entry);
+        source = "computed";
     }
+    ttt_out_printf(&output, "wins=%u losses=%u draws=%u shortest_loss=%u shortest_lines=%u source=%s\n",
+           entry.wins, entry.losses, entry.draws, entry.shortest_loss, entry.nshortest, source);
+}
 
-    return 0;
+/**
+ * @brief Make the program's move in a hosted game and report it.
+ *
+ * The game ends when the program wins or the board is full.
+ *
+ * @param id Game ID.
+ * @param game The game.
+ */
+void game_computer_move(long id, struct game *game) {
+    int cursor = game->cursor;
+    int move = ttt_pick(&game->strategy, &cursor, ttt_free(&game->board));
+    game->cursor = cursor;
+    if (move == -1) {
+        ttt_out_printf(&output, "%ld draw\n", id);
+        game->active = 0;
+        return;
+    }
+
+    game->board.x |= 1 << move;
+    ttt_out_printf(&output, "%ld move %d\n", id, move + 1);
+    if (ttt_is_win(game->board.x)) {
+        ttt_out_printf(&output, "%ld win\n", id);
+        game->active = 0;
+    } else if (ttt_free(&game->board) == 0) {
+        ttt_out_printf(&output, "%ld draw\n", id);
+        game->active = 0;
+    }
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2 || strlen(argv[1]) != BOARD_SIZE) {
-        printf("Error\n");
-        exit(1);
+/**
+ * @brief Apply one input line of multi-game mode.
+ *
+ * Lines are "<id> new <strategy>", "<id> <cell>" or "<id> quit", and every
+ * reply line starts with the ID it answers. A bad line only ends its own game.
+ *
+ * @param games Game table.
+ * @param max_games Size of the table; IDs are 0 to max_games - 1.
+ * @param line Input line.
+ */
+void game_line(struct game *games, long max_games, char *line) {
+    char *end;
+    long id = strtol(line, &end, 10);
+    if (end == line || id < 0 || id >= max_games) {
+        ttt_out_printf(&output, "error\n");
+        return;
     }
 
-    char* strategy = argv[1];
-    int digit_count[10] = {0};
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        if (strategy[i] < '1' || strategy[i] > '9' || ++digit_count[strategy[i] - '0'] > 1) {
-            printf("Error\n");
-            exit(1);
+    struct game *game = &games[id];
+    char arg[16];
+    if (sscanf(end, "%15s", arg) != 1) {
+        ttt_out_printf(&output, "%ld error\n", id);
+        return;
+    }
+
+    if (strcmp(arg, "new") == 0) {
+        char text[16];
+        *game = (struct game){0};
+        if (sscanf(end, "%*s %15s", text) != 1 || strlen(text) != BOARD_SIZE ||
+            ttt_parse_strategy(text, &game->strategy) == -1) {
+            ttt_out_printf(&output, "%ld error\n", id);
+            return;
         }
+        game->active = 1;
+        game_computer_move(id, game);
+        return;
     }
 
-    char board[BOARD_SIZE];
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        board[i] = ' ';
+    if (!game->active) {
+        ttt_out_printf(&output, "%ld error\n", id);
+        return;
+    }
+    if (strcmp(arg, "quit") == 0) {
+        game->active = 0;
+        ttt_out_printf(&output, "%ld quit\n", id);
+        return;
+    }
+
+    int move = ttt_game_parse_move(arg, BOARD_SIZE) - 1;  // Validated like read_move()
+    if (move < 0 || !(ttt_free(&game->board) >> move & 1)) {
+        game->active = 0;
+        ttt_out_printf(&output, "%ld error\n", id);
+        return;
+    }
+    game->board.o |= 1 << move;
+    if (ttt_is_win(game->board.o)) {
+        game->active = 0;
+        ttt_out_printf(&output, "%ld lost\n", id);
+        return;
     }
-    int move_count = 0;
+    game_computer_move(id, game);
+}
+
+/**
+ * @brief Host many games in one process, multiplexed over stdin and stdout.
+ *
+ * @param max_games Size of the game table.
+ * @return int Exit status.
+ */
+int serve_games(long max_games) {
+    struct game *games = calloc(max_games, sizeof(*games));
+    if (games == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    char line[256];
+    while (ttt_in_line(&input, line, sizeof(line)) != -1) {
+        game_line(games, max_games, line);
+    }
+    free(games);
+    return 0;
+}
 
+/**
+ * @brief Print an N x N board, one row per line, '.' for free cells.
+ */
+void print_board_n(const struct tttn_board *board) {
+    static const char marks[] = {'.', 'X', 'O'};
+    int n = board->n;
+    for (int r = 0; r < n; r++) {
+        for (int c = 0; c < n; c++) {
+            ttt_out_printf(&output, c == 0 ? "%c" : " %c", marks[tttn_owner(board, r * n + c) + 1]);
+        }
+        ttt_out_printf(&output, "\n");
+    }
+    ttt_out_printf(&output, "\n");
+}
+
+/**
+ * @brief Play one game on an N x N board where k in a row wins.
+ *
+ * The dialogue matches the 3 x 3 game. In terse mode each record is
+ * "<move> <status>" with the status characters of ttt_game_record().
+ *
+ * @param strategy Program's strategy.
+ * @param n Board side.
+ * @param k Run length that wins.
+ * @param terse Use the terse protocol.
+ * @return int Exit status: 0 when the game ends, 1 on a bad move.
+ */
+int play_n(const struct tttn_strategy *strategy, int n, int k, int terse) {
+    struct tttn_board board;
+    int cursor = 0;
+
+    tttn_init(&board, n, k);
     while (1) {
-        int move;
-        do {
-            if (move_count >= BOARD_SIZE) {
-                printf("DRAW\n");
-                return 0;
+        int move = tttn_pick(strategy, &cursor, &board);
+        if (move == -1) {
+            ttt_out_printf(&output, terse ? "0 D\n" : "DRAW\n");
+            return 0;
+        }
+
+        tttn_play(&board, 0, move);
+        char status = tttn_is_win(&board, 0, move) ? 'W' : tttn_full(&board) ? 'D' : '-';
+        if (terse) {
+            ttt_out_printf(&output, "%d %c\n", move + 1, status);
+        } else {
+            ttt_out_printf(&output, "Computer's turn: %d\n", move + 1);
+            print_board_n(&board);
+            if (status == 'W') {
+                ttt_out_printf(&output, "\033[1;32mI win \033[0m\n");
+            } else if (status == 'D') {
+                ttt_out_printf(&output, "DRAW\n");
             }
-            move = strategy[move_count++] - '0' - 1;
-        } while (board[move] != ' ');
+        }
+        if (status != '-') {
+            return 0;
+        }
 
-        printf("Computer's turn: %d\n", move + 1);
-        board[move] = 'X';
-        print_board(board);
+        if (!terse) {
+            ttt_out_printf(&output, "Human's turn: ");
+        }
+        move = read_move(n * n) - 1;
+        if (move < 0 || tttn_taken(&board, move)) {
+            ttt_out_printf(&output, terse ? "0 E\n" : "\nError\n");
+            return 1;
+        }
 
-        if (check_win(board, 'X')) {
-            printf("\033[1;32mI win \033[0m\n");
-            break;
+        tttn_play(&board, 1, move);
+        if (!terse) {
+            ttt_out_printf(&output, "\n");
+            print_board_n(&board);
         }
+        if (tttn_is_win(&board, 1, move)) {
+            ttt_out_printf(&output, terse ? "0 L\n" : "\033[1;31mI lost \033[0m\n");
+            return 0;
+        }
+    }
+}
 
-        printf("Human's turn: ");
-        scanf("%d", &move);
-        printf("\n");
-        move--;
+int main(int argc, char *argv[]) {
+    struct ttt_strategy strategy;
+    const char *index_path = TTT_INDEX_FILE;
+    int profile = 0;
+    int terse = 0;
+    long max_games = 0;
+    int side = 0, run = 0;
+    int opt;
 
-        if (move < 0 || move >= BOARD_SIZE || board[move] != ' ') {
-            printf("Error\n");
-            exit(1);
+    atexit(flush_output);
+    while ((opt = getopt(argc, argv, "sx:m:tn:k:")) != -1) {
+        switch (opt) {
+            case 's':
+                profile = 1;
+                break;
+            case 'm':
+                max_games = atol(optarg);
+                if (max_games <= 0) {
+                    ttt_out_printf(&output, "Error\n");
+                    exit(1);
+                }
+                break;
+            case 'x':
+                index_path = optarg;
+                break;
+            case 't':
+                terse = 1;
+                break;
+            case 'n':
+                side = atoi(optarg);
+                break;
+            case 'k':
+                run = atoi(optarg);
+                break;
+            default:
+                ttt_out_printf(&output, "Error\n");
+                exit(1);
         }
+    }
 
-        board[move] = 'O';
-        print_board(board);
+    if (max_games > 0) {
+        return serve_games(max_games);
+    }
 
-        if (check_win(board, 'O')) {
-            printf("\033[1;31mI lost \033[0m\n");
-            break;
+    if (side != 0 || run != 0) {
+        struct tttn_strategy nstrategy;
+        if (side == 0) {
+            side = 3;
+        }
+        if (run == 0) {
+            run = side < 5 ? side : 5;
+        }
+        if (side < 1 || side > TTTN_MAX || run < 1 || run > side || argc - optind != 1 ||
+            tttn_parse_strategy(argv[optind], side, &nstrategy) == -1) {
+            ttt_out_printf(&output, "Error\n");
+            exit(1);
         }
+        return play_n(&nstrategy, side, run, terse);
     }
 
-    return 0;
+    if (argc - optind != 1 || strlen(argv[optind]) != BOARD_SIZE || ttt_parse_strategy(argv[optind], &strategy) == -1) {
+        ttt_out_printf(&output, "Error\n");
+        exit(1);
+    }
+
+    if (profile) {
+        print_profile(&strategy, index_path);
+        return 0;
+    }
+
+    struct ttt_game game;
+    ttt_game_start(&game, &strategy, terse, &output);
+    while (!game.over) {
+        ttt_game_human(&game, read_move(BOARD_SIZE), &output);
+    }
+    return game.status;
 }
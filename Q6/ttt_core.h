@@ -0,0 +1,224 @@
+#ifndef TTT_CORE_H
+#define TTT_CORE_H
+
+#include <stdint.h>
+
+#define TTT_CELLS 9
+#define TTT_FULL 0x1FF  // Mask with all nine cells set
+#define TTT_MAX_HUMAN_MOVES 4  // The program moves first, so the human moves at most 4 times
+#define TTT_MAX_LINES 8        // Shortest losing lines kept per evaluation
+
+/**
+ * @brief Win lookup table over all 512 cell masks.
+ *
+ * Bit m of the table is set when mask m contains a complete row, column or
+ * diagonal, so a win test is one shift and one load from a 64 byte table.
+ * Cell i of the board (0 based, row major) is bit i of a mask.
+ */
+static const uint64_t TTT_WIN_TABLE[8] = {
+    0xff80808080808080ULL,
+    0xfff0aa80faf0aa80ULL,
+    0xffcc8080cccc8080ULL,
+    0xfffcaa80fefcaa80ULL,
+    0xfffaf0f0aaaa8080ULL,
+    0xfffafaf0fafaaa80ULL,
+    0xfffef0f0eeee8080ULL,
+    0xffffffffffffffffULL,
+};
+
+/**
+ * @brief The 8 winning lines as cell masks, for callers that need the line itself.
+ */
+static const uint16_t TTT_LINES[8] = {
+    0x007, 0x038, 0x1C0,  // rows
+    0x049, 0x092, 0x124,  // columns
+    0x111, 0x054          // diagonals
+};
+
+/**
+ * @brief A board as one 9-bit mask per player: X is the program, O the human.
+ */
+struct ttt_board {
+    uint16_t x;
+    uint16_t o;
+};
+
+/**
+ * @brief A validated strategy: cell indices in priority order.
+ */
+struct ttt_strategy {
+    uint8_t order[TTT_CELLS];
+};
+
+/**
+ * @brief Check whether a player's mask contains a winning line.
+ *
+ * @param mask 9-bit cell mask of one player.
+ * @return int Non-zero for a win.
+ */
+static inline int ttt_is_win(uint16_t mask) {
+    return (TTT_WIN_TABLE[mask >> 6] >> (mask & 63)) & 1;
+}
+
+/**
+ * @brief Mask of the cells still free on a board.
+ *
+ * @param board Board.
+ * @return uint16_t 9-bit mask of empty cells.
+ */
+static inline uint16_t ttt_free(const struct ttt_board *board) {
+    return ~(board->x | board->o) & TTT_FULL;
+}
+
+/**
+ * @brief Character of a cell as printed by ttt.
+ *
+ * @param board Board.
+ * @param cell Cell index 0..8.
+ * @return char 'X', 'O' or ' '.
+ */
+static inline char ttt_cell(const struct ttt_board *board, int cell) {
+    if (board->x >> cell & 1) {
+        return 'X';
+    }
+    return board->o >> cell & 1 ? 'O' : ' ';
+}
+
+/**
+ * @brief Parse a 9-digit strategy that must be a permutation of 1..9.
+ *
+ * @param text Strategy string.
+ * @param strategy Receives the 0 based cell order.
+ * @return int 0 on success, -1 if the string is not a permutation of 1..9.
+ */
+static inline int ttt_parse_strategy(const char *text, struct ttt_strategy *strategy) {
+    unsigned seen = 0;
+    for (int i = 0; i < TTT_CELLS; i++) {
+        if (text[i] < '1' || text[i] > '9' || (seen >> (text[i] - '1') & 1)) {
+            return -1;
+        }
+        seen |= 1u << (text[i] - '1');
+        strategy->order[i] = text[i] - '1';
+    }
+    return text[TTT_CELLS] == '\0' ? 0 : -1;
+}
+
+/**
+ * @brief Pick the program's move: the first free cell in strategy order.
+ *
+ * Cells never become free again, so the scan resumes from a cursor kept by
+ * the caller (start it at 0) and a whole game costs at most 9 steps.
+ *
+ * @param strategy Strategy.
+ * @param cursor Position in the strategy, advanced past the chosen cell.
+ * @param free Mask of free cells.
+ * @return int The chosen cell, or -1 when the board is full.
+ */
+static inline int ttt_pick(const struct ttt_strategy *strategy, int *cursor, uint16_t free) {
+    while (*cursor < TTT_CELLS) {
+        int cell = strategy->order[(*cursor)++];
+        if (free >> cell & 1) {
+            return cell;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Outcome of a strategy against every legal sequence of human moves.
+ *
+ * Counts are from the program's point of view. A line is the sequence of
+ * human cells (0 based) of one game.
+ */
+struct ttt_outcome {
+    uint32_t wins;
+    uint32_t losses;
+    uint32_t draws;
+    uint8_t shortest_loss;  // Human moves in the shortest losing line, 0 if it never loses
+    uint8_t nlines;         // Shortest losing lines stored (at most TTT_MAX_LINES)
+    uint32_t nshortest;     // Shortest losing lines found, including those not stored
+    uint8_t lines[TTT_MAX_LINES][TTT_MAX_HUMAN_MOVES];
+};
+
+/**
+ * @brief Record a lost game, keeping only the shortest lines.
+ */
+static inline void ttt_record_loss(struct ttt_outcome *out, const uint8_t *path, int depth) {
+    out->losses++;
+    if (out->shortest_loss == 0 || depth < out->shortest_loss) {
+        out->shortest_loss = depth;
+        out->nlines = 0;
+        out->nshortest = 0;
+    }
+    if (depth == out->shortest_loss) {
+        if (out->nlines < TTT_MAX_LINES) {
+            for (int i = 0; i < depth; i++) {
+                out->lines[out->nlines][i] = path[i];
+            }
+            out->nlines++;
+        }
+        out->nshortest++;
+    }
+}
+
+/**
+ * @brief Play out every human reply from a position where the program is to move.
+ *
+ * @param strategy Strategy of the program.
+ * @param board Current position.
+ * @param cursor Strategy cursor of the position.
+ * @param path Human moves leading to the position.
+ * @param depth Number of human moves in path.
+ * @param out Outcome to accumulate into.
+ */
+static inline void ttt_walk(const struct ttt_strategy *strategy, struct ttt_board board, int cursor,
+                            uint8_t *path, int depth, struct ttt_outcome *out) {
+    int move = ttt_pick(strategy, &cursor, ttt_free(&board));
+    if (move == -1) {
+        out->draws++;
+        return;
+    }
+    board.x |= 1 << move;
+    if (ttt_is_win(board.x)) {
+        out->wins++;
+        return;
+    }
+    if (ttt_free(&board) == 0) {
+        out->draws++;  // The program's fifth move filled the board
+        return;
+    }
+
+    uint16_t free = ttt_free(&board);
+    while (free != 0) {
+        int cell = __builtin_ctz(free);
+        free &= free - 1;
+
+        struct ttt_board next = board;
+        next.o |= 1 << cell;
+        path[depth] = cell;
+        if (ttt_is_win(next.o)) {
+            ttt_record_loss(out, path, depth + 1);
+        } else {
+            ttt_walk(strategy, next, cursor, path, depth + 1, out);
+        }
+    }
+}
+
+/**
+ * @brief Evaluate a strategy against every legal sequence of human moves.
+ *
+ * The program's replies are deterministic, so the tree only branches on
+ * the human's moves: at most 8 * 6 * 4 * 2 games.
+ *
+ * @param strategy Strategy to evaluate.
+ * @param out Receives the outcome.
+ */
+static inline void ttt_evaluate(const struct ttt_strategy *strategy, struct ttt_outcome *out) {
+    struct ttt_board board = {0, 0};
+    uint8_t path[TTT_MAX_HUMAN_MOVES];
+
+    *out = (struct ttt_outcome){0};
+    ttt_walk(strategy, board, 0, path, 0, out);
+}
+
+#endif
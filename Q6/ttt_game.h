@@ -0,0 +1,173 @@
+#ifndef TTT_GAME_H
+#define TTT_GAME_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ttt_core.h"
+#include "ttt_io.h"
+
+/**
+ * @brief One game of ttt as an event-driven state machine.
+ *
+ * The program moves in ttt_game_start() and after every human move passed
+ * to ttt_game_human(), writing its dialogue to a ttt_out. The ttt
+ * executable drives it from stdin and the mync plugin from socket data, so
+ * both speak exactly the same protocol.
+ */
+struct ttt_game {
+    struct ttt_strategy strategy;
+    struct ttt_board board;
+    uint8_t cursor;  // Strategy cursor, see ttt_pick()
+    uint8_t terse;   // One record per move instead of board drawings
+    uint8_t over;
+    uint8_t status;  // Exit status once over: 1 after an illegal move
+};
+
+/**
+ * @brief Draw a 3 x 3 board as ttt always has.
+ */
+static inline void ttt_game_print_board(struct ttt_out *out, const struct ttt_board *board) {
+    for (int i = 0; i < 3; ++i) {
+        ttt_out_printf(out, " %c | %c | %c \n", ttt_cell(board, i * 3 + 0), ttt_cell(board, i * 3 + 1),
+                       ttt_cell(board, i * 3 + 2));
+        if (i < 2) {
+            ttt_out_printf(out, "---+---+---\n");
+        }
+    }
+    ttt_out_printf(out, "\n");
+}
+
+/**
+ * @brief Emit one terse protocol record.
+ *
+ * The record is "<move> <x mask> <o mask> <status>\n": the program's cell
+ * (1 based, 0 when it did not move), each player's cells as 3 hex digits
+ * (bit i is cell i + 1), and '-' (human to move), 'W', 'L', 'D' or 'E'.
+ */
+static inline void ttt_game_record(struct ttt_out *out, int move, const struct ttt_board *board, char status) {
+    ttt_out_printf(out, "%d %03x %03x %c\n", move, board->x, board->o, status);
+}
+
+/**
+ * @brief End a game.
+ */
+static inline void ttt_game_end(struct ttt_game *game, int status) {
+    game->over = 1;
+    game->status = status;
+}
+
+/**
+ * @brief Make the program's move and prompt for the human's.
+ *
+ * @param game Game in progress.
+ * @param out Dialogue output.
+ */
+static inline void ttt_game_computer(struct ttt_game *game, struct ttt_out *out) {
+    int cursor = game->cursor;
+    int move = ttt_pick(&game->strategy, &cursor, ttt_free(&game->board));
+    game->cursor = cursor;
+    if (move == -1) {
+        if (game->terse) {
+            ttt_game_record(out, 0, &game->board, 'D');
+        } else {
+            ttt_out_printf(out, "DRAW\n");
+        }
+        ttt_game_end(game, 0);
+        return;
+    }
+
+    game->board.x |= 1 << move;
+    int win = ttt_is_win(game->board.x);
+    if (game->terse) {
+        char status = win ? 'W' : ttt_free(&game->board) == 0 ? 'D' : '-';
+        ttt_game_record(out, move + 1, &game->board, status);
+        if (status != '-') {
+            ttt_game_end(game, 0);
+        }
+        return;
+    }
+
+    ttt_out_printf(out, "Computer's turn: %d\n", move + 1);
+    ttt_game_print_board(out, &game->board);
+    if (win) {
+        ttt_out_printf(out, "\033[1;32mI win \033[0m\n");
+        ttt_game_end(game, 0);
+        return;
+    }
+    if (ttt_free(&game->board) == 0) {
+        ttt_out_printf(out, "DRAW\n");  // The fifth move filled the board, as in play_n()
+        ttt_game_end(game, 0);
+        return;
+    }
+    ttt_out_printf(out, "Human's turn: ");
+}
+
+/**
+ * @brief Start a game: the program always moves first.
+ *
+ * @param game Game to initialize.
+ * @param strategy Program's strategy.
+ * @param terse Use the terse protocol.
+ * @param out Dialogue output.
+ */
+static inline void ttt_game_start(struct ttt_game *game, const struct ttt_strategy *strategy, int terse,
+                                  struct ttt_out *out) {
+    *game = (struct ttt_game){0};
+    game->strategy = *strategy;
+    game->terse = terse;
+    ttt_game_computer(game, out);
+}
+
+/**
+ * @brief Parse a move token.
+ *
+ * @param tok Token.
+ * @param ncells Number of cells on the board.
+ * @return int The move as typed (1 based), or 0 if the token is not a cell number.
+ */
+static inline int ttt_game_parse_move(const char *tok, int ncells) {
+    char *end;
+    long move = strtol(tok, &end, 10);
+    return end != tok && *end == '\0' && move > 0 && move <= ncells ? move : 0;
+}
+
+/**
+ * @brief Apply the human's move and answer it.
+ *
+ * @param game Game in progress.
+ * @param move Move as typed (1 based), 0 for anything that was not a cell.
+ * @param out Dialogue output.
+ */
+static inline void ttt_game_human(struct ttt_game *game, int move, struct ttt_out *out) {
+    move--;
+    if (!game->terse) {
+        ttt_out_printf(out, "\n");
+    }
+    if (move < 0 || move >= TTT_CELLS || !(ttt_free(&game->board) >> move & 1)) {
+        if (game->terse) {
+            ttt_game_record(out, 0, &game->board, 'E');
+        } else {
+            ttt_out_printf(out, "Error\n");
+        }
+        ttt_game_end(game, 1);
+        return;
+    }
+
+    game->board.o |= 1 << move;
+    if (!game->terse) {
+        ttt_game_print_board(out, &game->board);
+    }
+    if (ttt_is_win(game->board.o)) {
+        if (game->terse) {
+            ttt_game_record(out, 0, &game->board, 'L');
+        } else {
+            ttt_out_printf(out, "\033[1;31mI lost \033[0m\n");
+        }
+        ttt_game_end(game, 0);
+        return;
+    }
+    ttt_game_computer(game, out);
+}
+
+#endif
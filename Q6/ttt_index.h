@@ -0,0 +1,162 @@
+#ifndef TTT_INDEX_H
+#define TTT_INDEX_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ttt_core.h"
+
+#define TTT_INDEX_MAGIC "TTTIDX2"  // 8 bytes including the terminator; bumped when entries change meaning
+#define TTT_INDEX_MAGIC_LEN 8
+#define TTT_STRATEGIES 362880      // 9!, every permutation of 1..9
+#define TTT_INDEX_FILE "ttt.idx"   // Default index path
+
+/**
+ * @brief Outcome summary of one strategy as stored in the index.
+ */
+struct ttt_index_entry {
+    uint16_t wins;
+    uint16_t losses;
+    uint16_t draws;
+    uint8_t shortest_loss;  // Human moves in the shortest losing line, 0 if it never loses
+    uint8_t nshortest;      // Number of shortest losing lines, saturated at 255
+};
+
+/**
+ * @brief Index file header, followed by TTT_STRATEGIES entries in rank order.
+ *
+ * Fields are stored in host byte order; the index is a build artifact.
+ */
+struct ttt_index_header {
+    char magic[TTT_INDEX_MAGIC_LEN];
+    uint32_t count;
+    uint32_t entry_size;
+};
+
+/**
+ * @brief A memory-mapped index.
+ */
+struct ttt_index {
+    void *map;
+    size_t size;
+    const struct ttt_index_entry *entries;
+};
+
+static const uint32_t TTT_FACTORIAL[TTT_CELLS] = {1, 1, 2, 6, 24, 120, 720, 5040, 40320};
+
+/**
+ * @brief Rank of a strategy among all permutations (its Lehmer code).
+ *
+ * @param strategy Strategy to rank.
+ * @return uint32_t Rank in [0, 9!), lexicographic order of the digit strings.
+ */
+static inline uint32_t ttt_rank(const struct ttt_strategy *strategy) {
+    uint32_t rank = 0;
+    unsigned unused = TTT_FULL;
+    for (int i = 0; i < TTT_CELLS; i++) {
+        int cell = strategy->order[i];
+        rank += __builtin_popcount(unused & ((1u << cell) - 1)) * TTT_FACTORIAL[TTT_CELLS - 1 - i];
+        unused &= ~(1u << cell);
+    }
+    return rank;
+}
+
+/**
+ * @brief Strategy of a given rank, the inverse of ttt_rank().
+ *
+ * @param rank Rank in [0, 9!).
+ * @param strategy Receives the strategy.
+ */
+static inline void ttt_unrank(uint32_t rank, struct ttt_strategy *strategy) {
+    unsigned unused = TTT_FULL;
+    for (int i = 0; i < TTT_CELLS; i++) {
+        uint32_t digit = rank / TTT_FACTORIAL[TTT_CELLS - 1 - i];
+        rank %= TTT_FACTORIAL[TTT_CELLS - 1 - i];
+
+        // Select the digit-th unused cell
+        unsigned mask = unused;
+        for (uint32_t k = 0; k < digit; k++) {
+            mask &= mask - 1;
+        }
+        int cell = __builtin_ctz(mask);
+        strategy->order[i] = cell;
+        unused &= ~(1u << cell);
+    }
+}
+
+/**
+ * @brief Pack a full evaluation into an index entry.
+ *
+ * @param out Evaluation result.
+ * @param entry Receives the packed summary.
+ */
+static inline void ttt_index_pack(const struct ttt_outcome *out, struct ttt_index_entry *entry) {
+    entry->wins = out->wins;
+    entry->losses = out->losses;
+    entry->draws = out->draws;
+    entry->shortest_loss = out->shortest_loss;
+    entry->nshortest = out->nshortest > 255 ? 255 : out->nshortest;
+}
+
+/**
+ * @brief Map an index file and validate its header.
+ *
+ * @param index Index to initialize.
+ * @param path Path of the index file.
+ * @return int 0 on success, -1 if the file is missing or invalid.
+ */
+static inline int ttt_index_open(struct ttt_index *index, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    size_t expected = sizeof(struct ttt_index_header) + (size_t)TTT_STRATEGIES * sizeof(struct ttt_index_entry);
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size != expected) {
+        close(fd);
+        return -1;
+    }
+
+    index->size = expected;
+    index->map = mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (index->map == MAP_FAILED) {
+        return -1;
+    }
+
+    const struct ttt_index_header *hdr = index->map;
+    if (memcmp(hdr->magic, TTT_INDEX_MAGIC, TTT_INDEX_MAGIC_LEN) != 0 || hdr->count != TTT_STRATEGIES ||
+        hdr->entry_size != sizeof(struct ttt_index_entry)) {
+        munmap(index->map, index->size);
+        return -1;
+    }
+    index->entries = (const struct ttt_index_entry *)(hdr + 1);
+    return 0;
+}
+
+/**
+ * @brief O(1) lookup of a strategy's outcome summary.
+ *
+ * @param index Open index.
+ * @param strategy Strategy to look up.
+ * @return const struct ttt_index_entry* The entry inside the mapping.
+ */
+static inline const struct ttt_index_entry *ttt_index_lookup(const struct ttt_index *index,
+                                                             const struct ttt_strategy *strategy) {
+    return &index->entries[ttt_rank(strategy)];
+}
+
+/**
+ * @brief Unmap an index.
+ *
+ * @param index Open index.
+ */
+static inline void ttt_index_close(struct ttt_index *index) {
+    munmap(index->map, index->size);
+}
+
+#endif
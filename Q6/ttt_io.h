@@ -0,0 +1,212 @@
+#ifndef TTT_IO_H
+#define TTT_IO_H
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TTT_IO_BUFFER 4096
+
+/**
+ * @brief Output buffer written to its fd with as few write() calls as possible.
+ *
+ * Output is only written when the buffer fills, when input is about to
+ * block, or on an explicit flush, so a whole turn leaves in one write
+ * whether the fd is a TTY, a pipe or a socket.
+ */
+struct ttt_out {
+    int fd;
+    size_t len;
+    ssize_t (*write)(void *ctx, const void *data, size_t len);  // Replaces write(fd) when set
+    void *ctx;
+    char buf[TTT_IO_BUFFER];
+};
+
+/**
+ * @brief Input buffer over raw read(), split into tokens or lines.
+ *
+ * Output is flushed before every read() that may block, so a prompt never
+ * waits in a buffer while the program waits for its answer.
+ */
+struct ttt_in {
+    int fd;
+    int eof;
+    size_t start;  // First unconsumed byte
+    size_t end;    // End of buffered data
+    struct ttt_out *flush;  // Flushed before reading, or NULL
+    char buf[TTT_IO_BUFFER];
+};
+
+/**
+ * @brief Write out everything buffered.
+ *
+ * A failed write means the peer is gone, so the process exits. Sinks set
+ * through the write member report failure without exiting by accepting
+ * everything and recording the error themselves.
+ *
+ * @param out Output buffer.
+ */
+static inline void ttt_out_flush(struct ttt_out *out) {
+    size_t done = 0;
+    while (done < out->len) {
+        ssize_t n = out->write ? out->write(out->ctx, out->buf + done, out->len - done)
+                               : write(out->fd, out->buf + done, out->len - done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            out->len = 0;
+            _exit(1);
+        }
+        done += n;
+    }
+    out->len = 0;
+}
+
+/**
+ * @brief Append formatted text to the output buffer.
+ *
+ * @param out Output buffer.
+ * @param fmt printf() format.
+ */
+static inline void ttt_out_printf(struct ttt_out *out, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(out->buf + out->len, sizeof(out->buf) - out->len, fmt, ap);
+    va_end(ap);
+
+    if (len >= 0 && (size_t)len >= sizeof(out->buf) - out->len) {
+        // Did not fit: flush and format again into the empty buffer
+        ttt_out_flush(out);
+        va_start(ap, fmt);
+        len = vsnprintf(out->buf, sizeof(out->buf), fmt, ap);
+        va_end(ap);
+        if ((size_t)len >= sizeof(out->buf)) {
+            len = sizeof(out->buf) - 1;
+        }
+    }
+    if (len > 0) {
+        out->len += len;
+    }
+}
+
+/**
+ * @brief Refill the input buffer with one read(), keeping unconsumed bytes.
+ *
+ * @param in Input buffer.
+ * @return int 1 if data was added, 0 at end of input or when the buffer is full.
+ */
+static inline int ttt_in_fill(struct ttt_in *in) {
+    if (in->eof) {
+        return 0;
+    }
+    if (in->start > 0) {
+        memmove(in->buf, in->buf + in->start, in->end - in->start);
+        in->end -= in->start;
+        in->start = 0;
+    }
+    if (in->end == sizeof(in->buf)) {
+        return 0;
+    }
+    if (in->flush != NULL) {
+        ttt_out_flush(in->flush);
+    }
+
+    ssize_t n;
+    do {
+        n = read(in->fd, in->buf + in->end, sizeof(in->buf) - in->end);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        in->eof = 1;
+        return 0;
+    }
+    in->end += n;
+    return 1;
+}
+
+/**
+ * @brief Check whether a byte separates tokens.
+ *
+ * strchr() would also match the terminating NUL, so a NUL byte is checked
+ * for explicitly: it belongs to a token instead of ending one.
+ */
+static inline int ttt_is_space(char c) {
+    return c != '\0' && strchr(" \t\r\n", c) != NULL;
+}
+
+/**
+ * @brief Read the next whitespace-separated token.
+ *
+ * Tokens may be split across reads, and one read may carry several. Tokens
+ * longer than the destination are truncated.
+ *
+ * @param in Input buffer.
+ * @param tok Receives the NUL terminated token.
+ * @param size Size of tok.
+ * @return int Token length, or -1 at end of input.
+ */
+static inline int ttt_in_token(struct ttt_in *in, char *tok, size_t size) {
+    size_t len = 0;
+
+    while (1) {
+        while (in->start < in->end && len == 0 && ttt_is_space(in->buf[in->start])) {
+            in->start++;
+        }
+        while (in->start < in->end && !ttt_is_space(in->buf[in->start])) {
+            if (len + 1 < size) {
+                tok[len++] = in->buf[in->start];
+            }
+            in->start++;
+        }
+        if (in->start < in->end || !ttt_in_fill(in)) {
+            break;
+        }
+    }
+
+    tok[len] = '\0';
+    return len > 0 ? (int)len : -1;
+}
+
+/**
+ * @brief Read the next line, without its terminator.
+ *
+ * Lines longer than the destination are truncated and the rest discarded.
+ * A final line without a newline is still returned.
+ *
+ * @param in Input buffer.
+ * @param line Receives the NUL terminated line.
+ * @param size Size of line.
+ * @return int Line length, or -1 at end of input.
+ */
+static inline int ttt_in_line(struct ttt_in *in, char *line, size_t size) {
+    size_t len = 0;
+    int any = 0;
+
+    while (1) {
+        while (in->start < in->end) {
+            char c = in->buf[in->start++];
+            any = 1;
+            if (c == '\n') {
+                if (len > 0 && line[len - 1] == '\r') {
+                    len--;
+                }
+                line[len] = '\0';
+                return len;
+            }
+            if (len + 1 < size) {
+                line[len++] = c;
+            }
+        }
+        if (!ttt_in_fill(in)) {
+            break;
+        }
+    }
+
+    line[len] = '\0';
+    return any ? (int)len : -1;
+}
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef TTT_OPPONENT_H
+#define TTT_OPPONENT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ttt_core.h"
+#include "ttt_io.h"
+
+#define TTT_POSITIONS 19683  // 3^9 encodings of a board
+#define TTT_SYMMETRIES 8
+
+/**
+ * @brief Cell permutations of the 8 symmetries of the board.
+ *
+ * Entry s maps cell i to TTT_SYMMETRY[s][i].
+ */
+static const uint8_t TTT_SYMMETRY[TTT_SYMMETRIES][TTT_CELLS] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8},  // identity
+    {2, 5, 8, 1, 4, 7, 0, 3, 6},  // rotate 90
+    {8, 7, 6, 5, 4, 3, 2, 1, 0},  // rotate 180
+    {6, 3, 0, 7, 4, 1, 8, 5, 2},  // rotate 270
+    {2, 1, 0, 5, 4, 3, 8, 7, 6},  // mirror left-right
+    {6, 7, 8, 3, 4, 5, 0, 1, 2},  // mirror top-bottom
+    {0, 3, 6, 1, 4, 7, 2, 5, 8},  // transpose
+    {8, 5, 2, 7, 4, 1, 6, 3, 0},  // anti-transpose
+};
+
+/**
+ * @brief Negamax values of canonical positions, as value + 2 (0 is unknown).
+ *
+ * Only the canonical representative of each symmetry class is stored:
+ * ttt_opponent_prepare() fills 765 of the entries, one per class of
+ * reachable position, terminal positions included.
+ */
+static int8_t ttt_values[TTT_POSITIONS];
+
+enum ttt_opponent_kind {
+    TTT_OPPONENT_PERFECT,  // Negamax, never loses
+    TTT_OPPONENT_RANDOM,   // Uniform over free cells
+    TTT_OPPONENT_SCRIPT,   // Fixed cells in order, then the lowest free cell
+};
+
+/**
+ * @brief A human-side (O) player.
+ */
+struct ttt_opponent {
+    enum ttt_opponent_kind kind;
+    uint64_t rng;  // xorshift64 state of the random player
+    uint8_t script[TTT_CELLS];
+    int nscript;
+    int pos;  // Next script entry
+};
+
+/**
+ * @brief Base-3 code of a board under one symmetry: free 0, X 1, O 2.
+ */
+static inline int ttt_encode(const struct ttt_board *board, int sym) {
+    int code = 0;
+    for (int i = 0; i < TTT_CELLS; i++) {
+        int cell = TTT_SYMMETRY[sym][i];
+        code = code * 3 + ((board->x >> cell & 1) ? 1 : (board->o >> cell & 1) ? 2 : 0);
+    }
+    return code;
+}
+
+/**
+ * @brief Smallest code over the 8 symmetries, the key of a position's class.
+ */
+static inline int ttt_canonical(const struct ttt_board *board) {
+    int best = ttt_encode(board, 0);
+    for (int s = 1; s < TTT_SYMMETRIES; s++) {
+        int code = ttt_encode(board, s);
+        if (code < best) {
+            best = code;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Value of a position for the side to move: 1 win, 0 draw, -1 loss.
+ *
+ * The search is exhaustive rather than cut off at the first win, so every
+ * reachable class, terminal ones included, ends up in the table.
+ *
+ * @param board Position.
+ * @param o_to_move Non-zero if O moves next.
+ * @return int Value under perfect play.
+ */
+static inline int ttt_negamax(struct ttt_board board, int o_to_move) {
+    int key = ttt_canonical(&board);
+    if (ttt_values[key] != 0) {
+        return ttt_values[key] - 2;
+    }
+
+    int best;
+    uint16_t free = ttt_free(&board);
+    if (ttt_is_win(o_to_move ? board.x : board.o)) {
+        best = -1;
+    } else if (free == 0) {
+        best = 0;
+    } else {
+        best = -1;
+        while (free != 0) {
+            int cell = __builtin_ctz(free);
+            free &= free - 1;
+
+            struct ttt_board next = board;
+            *(o_to_move ? &next.o : &next.x) |= 1 << cell;
+            int value = -ttt_negamax(next, !o_to_move);
+            if (value > best) {
+                best = value;
+            }
+        }
+    }
+    ttt_values[key] = best + 2;
+    return best;
+}
+
+/**
+ * @brief Solve every position reachable from the empty board.
+ *
+ * Call once before sharing the table between threads; lookups afterwards
+ * are read-only.
+ */
+static inline void ttt_opponent_prepare(void) {
+    struct ttt_board board = {0, 0};
+    ttt_negamax(board, 0);
+}
+
+/**
+ * @brief Parse an opponent spec.
+ *
+ * Specs are "perfect", "random[:seed]" or "script:<cell>,<cell>,..." with
+ * 1 based cells.
+ *
+ * @param spec Spec string.
+ * @param opp Receives the opponent.
+ * @return int 0 on success, -1 for an invalid spec.
+ */
+static inline int ttt_opponent_parse(const char *spec, struct ttt_opponent *opp) {
+    memset(opp, 0, sizeof(*opp));
+    if (strcmp(spec, "perfect") == 0) {
+        opp->kind = TTT_OPPONENT_PERFECT;
+        ttt_opponent_prepare();
+        return 0;
+    }
+    if (strncmp(spec, "random", 6) == 0 && (spec[6] == '\0' || spec[6] == ':')) {
+        opp->kind = TTT_OPPONENT_RANDOM;
+        opp->rng = spec[6] == ':' ? strtoull(spec + 7, NULL, 10) : 1;
+        opp->rng = opp->rng * 2685821657736338717ULL + 1;
+        return 0;
+    }
+    if (strncmp(spec, "script:", 7) == 0) {
+        opp->kind = TTT_OPPONENT_SCRIPT;
+        const char *p = spec + 7;
+        while (*p != '\0' && opp->nscript < TTT_CELLS) {
+            char *end;
+            long cell = strtol(p, &end, 10);
+            if (end == p || cell < 1 || cell > TTT_CELLS || (*end != ',' && *end != '\0')) {
+                return -1;
+            }
+            opp->script[opp->nscript++] = cell - 1;
+            p = *end == ',' ? end + 1 : end;
+        }
+        return *p == '\0' && opp->nscript > 0 ? 0 : -1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Choose O's move.
+ *
+ * @param opp Opponent.
+ * @param board Position with O to move and at least one free cell.
+ * @return int The chosen cell.
+ */
+static inline int ttt_opponent_move(struct ttt_opponent *opp, const struct ttt_board *board) {
+    uint16_t free = ttt_free(board);
+
+    switch (opp->kind) {
+        case TTT_OPPONENT_PERFECT: {
+            int best = -2, best_cell = __builtin_ctz(free);
+            while (free != 0) {
+                int cell = __builtin_ctz(free);
+                free &= free - 1;
+
+                struct ttt_board next = *board;
+                next.o |= 1 << cell;
+                int value = -ttt_negamax(next, 0);
+                if (value > best) {
+                    best = value;
+                    best_cell = cell;
+                }
+            }
+            return best_cell;
+        }
+        case TTT_OPPONENT_RANDOM: {
+            opp->rng ^= opp->rng >> 12;
+            opp->rng ^= opp->rng << 25;
+            opp->rng ^= opp->rng >> 27;
+            int pick = (opp->rng * 2685821657736338717ULL >> 32) % __builtin_popcount(free);
+            while (pick-- > 0) {
+                free &= free - 1;
+            }
+            return __builtin_ctz(free);
+        }
+        case TTT_OPPONENT_SCRIPT:
+            while (opp->pos < opp->nscript) {
+                int cell = opp->script[opp->pos++];
+                if (free >> cell & 1) {
+                    return cell;
+                }
+            }
+            return __builtin_ctz(free);
+    }
+    return __builtin_ctz(free);
+}
+
+/**
+ * @brief Play one game of a strategy against an opponent.
+ *
+ * A script restarts from its first cell; a random player keeps its state,
+ * so successive games differ.
+ *
+ * @param strategy Program's strategy.
+ * @param opp Opponent.
+ * @return int 1 if the program wins, -1 if it loses, 0 for a draw.
+ */
+static inline int ttt_play_game(const struct ttt_strategy *strategy, struct ttt_opponent *opp) {
+    struct ttt_board board = {0, 0};
+    int cursor = 0;
+
+    opp->pos = 0;
+    while (1) {
+        int move = ttt_pick(strategy, &cursor, ttt_free(&board));
+        if (move == -1) {
+            return 0;
+        }
+        board.x |= 1 << move;
+        if (ttt_is_win(board.x)) {
+            return 1;
+        }
+        if (ttt_free(&board) == 0) {
+            return 0;
+        }
+
+        board.o |= 1 << ttt_opponent_move(opp, &board);
+        if (ttt_is_win(board.o)) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief Play one game as O against a ttt -t speaking the terse protocol.
+ *
+ * The board is rebuilt from the masks of each record, so nothing but the
+ * opponent carries state between moves.
+ *
+ * @param in_fd Where the records come from.
+ * @param out_fd Where the moves go.
+ * @param opp Opponent.
+ * @return int The final status character, or 'E' if the peer went away.
+ */
+static inline int ttt_opponent_play_terse(int in_fd, int out_fd, struct ttt_opponent *opp) {
+    struct ttt_out out = {.fd = out_fd};
+    struct ttt_in in = {.fd = in_fd, .flush = &out};
+    char move[8], x[8], o[8], status[4];
+
+    opp->pos = 0;
+    while (ttt_in_token(&in, move, sizeof(move)) != -1 && ttt_in_token(&in, x, sizeof(x)) != -1 &&
+           ttt_in_token(&in, o, sizeof(o)) != -1 && ttt_in_token(&in, status, sizeof(status)) != -1) {
+        if (status[0] != '-') {
+            return status[0];
+        }
+
+        struct ttt_board board = {strtol(x, NULL, 16), strtol(o, NULL, 16)};
+        if (ttt_free(&board) == 0) {
+            return 'E';
+        }
+        ttt_out_printf(&out, "%d\n", ttt_opponent_move(opp, &board) + 1);
+    }
+    return 'E';
+}
+
+#endif
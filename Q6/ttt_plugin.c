@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mync_plugin.h"
+#include "ttt_core.h"
+#include "ttt_game.h"
+#include "ttt_io.h"
+
+/**
+ * @brief State of one game hosted inside mync.
+ */
+struct ttt_session {
+    const struct mync_host *host;
+    struct mync_session *session;
+    struct ttt_game game;
+    struct ttt_out out;
+    char tok[16];  // Move token split across chunks
+    size_t toklen;
+};
+
+/**
+ * @brief ttt_out sink handing a turn's output to mync in one send.
+ *
+ * mync queues whatever the client does not accept yet, so the whole buffer
+ * is always reported as written.
+ */
+static ssize_t session_sink(void *ctx, const void *data, size_t len) {
+    struct ttt_session *t = ctx;
+    t->host->send(t->session, data, len);
+    return len;
+}
+
+/**
+ * @brief mync_plugin.init: parse "[-t] <strategy>" and make the first move.
+ */
+static void *ttt_init(const struct mync_host *host, struct mync_session *session, const char *arg) {
+    struct ttt_strategy strategy;
+    char text[32];
+    int terse = 0;
+
+    while (*arg == ' ') {
+        arg++;
+    }
+    if (strncmp(arg, "-t ", 3) == 0) {
+        terse = 1;
+        arg += 3;
+        while (*arg == ' ') {
+            arg++;
+        }
+    }
+    size_t len = strcspn(arg, " ");
+    if (len != TTT_CELLS || arg[len] != '\0') {
+        host->send(session, "Error\n", 6);
+        return NULL;
+    }
+    memcpy(text, arg, len);
+    text[len] = '\0';
+    if (ttt_parse_strategy(text, &strategy) == -1) {
+        host->send(session, "Error\n", 6);
+        return NULL;
+    }
+
+    struct ttt_session *t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->host = host;
+    t->session = session;
+    t->out.write = session_sink;
+    t->out.ctx = t;
+
+    ttt_game_start(&t->game, &strategy, terse, &t->out);
+    ttt_out_flush(&t->out);
+    if (t->game.over) {
+        host->close(session);
+    }
+    return t;
+}
+
+/**
+ * @brief mync_plugin.on_data: play every complete move in the chunk.
+ *
+ * Moves are whitespace separated like on ttt's stdin; a move cut by the
+ * chunk boundary is kept until its end arrives. At EOF the last move is
+ * played, and a game still waiting for a move ends with the error ttt
+ * reports at the end of its input. All replies to the chunk leave in one
+ * send.
+ */
+static int ttt_on_data(void *state, const char *data, size_t len) {
+    struct ttt_session *t = state;
+
+    if (data == NULL) {
+        if (t->toklen > 0 && !t->game.over) {
+            t->tok[t->toklen] = '\0';
+            t->toklen = 0;
+            ttt_game_human(&t->game, ttt_game_parse_move(t->tok, TTT_CELLS), &t->out);
+        }
+        if (!t->game.over) {
+            ttt_game_human(&t->game, 0, &t->out);
+        }
+        ttt_out_flush(&t->out);
+        return -1;
+    }
+
+    for (size_t i = 0; i < len && !t->game.over; i++) {
+        if (!ttt_is_space(data[i])) {
+            if (t->toklen + 1 < sizeof(t->tok)) {
+                t->tok[t->toklen++] = data[i];
+            }
+            continue;
+        }
+        if (t->toklen > 0) {
+            t->tok[t->toklen] = '\0';
+            t->toklen = 0;
+            ttt_game_human(&t->game, ttt_game_parse_move(t->tok, TTT_CELLS), &t->out);
+        }
+    }
+
+    ttt_out_flush(&t->out);
+    return t->game.over ? -1 : 0;
+}
+
+/**
+ * @brief mync_plugin.on_close: free the game.
+ */
+static void ttt_on_close(void *state) {
+    free(state);
+}
+
+const struct mync_plugin mync_plugin = {MYNC_PLUGIN_ABI, "ttt", ttt_init, ttt_on_data, ttt_on_close};
@@ -0,0 +1,340 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ttt_core.h"
+#include "ttt_opponent.h"
+#include "tttn_core.h"
+
+#define BENCH_MIN_NS 200000000L  // Each measurement runs at least this long
+#define BENCH_STRATEGY "123456789"
+#define BENCH_PORT 40599
+
+static volatile uint64_t sink;  // Results go here so loops are not optimized away
+
+/**
+ * @brief A measured operation: runs n iterations.
+ */
+typedef void (*bench_fn)(long n);
+
+/**
+ * @brief Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/**
+ * @brief Print one result line: name, value, unit.
+ *
+ * The format is stable so runs can be diffed or parsed: one result per
+ * line, whitespace separated, no other output on stdout.
+ */
+static void report(const char *name, double value, const char *unit) {
+    printf("%-20s %14.2f %s\n", name, value, unit);
+    fflush(stdout);
+}
+
+/**
+ * @brief Time fn, doubling the iteration count until a run is long enough.
+ *
+ * @param name Result name.
+ * @param fn Operation.
+ */
+static void bench(const char *name, bench_fn fn) {
+    long n = 1000, elapsed;
+    while (1) {
+        long start = now_ns();
+        fn(n);
+        elapsed = now_ns() - start;
+        if (elapsed >= BENCH_MIN_NS) {
+            break;
+        }
+        n *= 2;
+    }
+    report(name, (double)elapsed / n, "ns/op");
+}
+
+static void bench_is_win(long n) {
+    uint64_t acc = 0;
+    for (long i = 0; i < n; i++) {
+        acc += ttt_is_win((i * 97) & TTT_FULL);
+    }
+    sink = acc;
+}
+
+static void bench_pick(long n) {
+    struct ttt_strategy strategy;
+    uint64_t acc = 0;
+    ttt_parse_strategy(BENCH_STRATEGY, &strategy);
+    for (long i = 0; i < n; i++) {
+        int cursor = 0;
+        acc += ttt_pick(&strategy, &cursor, (i * 97) & TTT_FULL);
+    }
+    sink = acc;
+}
+
+static void bench_game(long n) {
+    struct ttt_strategy strategy;
+    struct ttt_opponent opp;
+    uint64_t acc = 0;
+    ttt_parse_strategy(BENCH_STRATEGY, &strategy);
+    ttt_opponent_parse("random:1", &opp);
+    for (long i = 0; i < n; i++) {
+        acc += ttt_play_game(&strategy, &opp);
+    }
+    sink = acc;
+}
+
+static void bench_evaluate(long n) {
+    struct ttt_strategy strategy;
+    struct ttt_outcome outcome;
+    uint64_t acc = 0;
+    ttt_parse_strategy(BENCH_STRATEGY, &strategy);
+    for (long i = 0; i < n; i++) {
+        ttt_evaluate(&strategy, &outcome);
+        acc += outcome.wins;
+    }
+    sink = acc;
+}
+
+/**
+ * @brief A 15 x 15 board half full with no five in a row, for the N x N win tests.
+ */
+static void nxn_board(struct tttn_board *board) {
+    tttn_init(board, 15, 5);
+    for (int cell = 0; cell < 15 * 15; cell++) {
+        int r = cell / 15, c = cell % 15;
+        if ((r + c / 2) % 2 == 0 && (r * 7 + c * 3) % 5 != 0) {
+            tttn_play(board, 0, cell);
+        }
+    }
+}
+
+static void bench_nxn_scalar(long n) {
+    struct tttn_board board;
+    uint64_t acc = 0;
+    nxn_board(&board);
+    for (long i = 0; i < n; i++) {
+        acc += tttn_is_win_scalar(&board, 0, i % 225);
+    }
+    sink = acc;
+}
+
+#ifdef TTTN_SIMD
+static void bench_nxn_sse2(long n) {
+    struct tttn_board board;
+    uint64_t acc = 0;
+    nxn_board(&board);
+    for (long i = 0; i < n; i++) {
+        board.rows[1][0] = i;  // Defeats hoisting the test out of the loop
+        acc += tttn_is_win_sse2(&board, 0);
+    }
+    sink = acc;
+}
+
+static void bench_nxn_avx2(long n) {
+    struct tttn_board board;
+    uint64_t acc = 0;
+    nxn_board(&board);
+    for (long i = 0; i < n; i++) {
+        board.rows[1][0] = i;
+        acc += tttn_is_win_avx2(&board, 0);
+    }
+    sink = acc;
+}
+#endif
+
+/**
+ * @brief Play games against ttt -t processes over pipes, one process per game.
+ *
+ * @param ttt Path of the ttt binary.
+ * @param games Games to play.
+ */
+static void bench_pipe(const char *ttt, long games) {
+    struct ttt_opponent opp;
+    ttt_opponent_parse("random:1", &opp);
+
+    long start = now_ns();
+    for (long g = 0; g < games; g++) {
+        int to_child[2], from_child[2];
+        if (pipe(to_child) == -1 || pipe(from_child) == -1) {
+            perror("Pipe failed");
+            exit(EXIT_FAILURE);
+        }
+
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("Fork failed");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            dup2(to_child[0], STDIN_FILENO);
+            dup2(from_child[1], STDOUT_FILENO);
+            close(to_child[0]);
+            close(to_child[1]);
+            close(from_child[0]);
+            close(from_child[1]);
+            execl(ttt, ttt, "-t", BENCH_STRATEGY, (char *)NULL);
+            _exit(127);
+        }
+
+        close(to_child[0]);
+        close(from_child[1]);
+        if (ttt_opponent_play_terse(from_child[0], to_child[1], &opp) == 'E') {
+            fprintf(stderr, "Pipe game %ld failed\n", g);
+            exit(EXIT_FAILURE);
+        }
+        close(to_child[1]);
+        close(from_child[0]);
+        waitpid(pid, NULL, 0);
+    }
+    report("pipe_games", games / ((now_ns() - start) / 1e9), "games/s");
+}
+
+/**
+ * @brief Play games against ttt -t hosted by mync -b TCPMUXS over loopback.
+ *
+ * @param name Result name.
+ * @param mync Path of the mync binary.
+ * @param option "-e" to fork the ttt binary per game, "-E" to load the ttt plugin.
+ * @param ttt Path of the ttt binary or plugin.
+ * @param port Loopback port.
+ * @param games Games to play.
+ */
+static void bench_mync(const char *name, const char *mync, const char *option, const char *ttt, int port,
+                       long games) {
+    char command[4096], endpoint[32];
+    snprintf(command, sizeof(command), "%s -t %s", ttt, BENCH_STRATEGY);
+    snprintf(endpoint, sizeof(endpoint), "TCPMUXS%d", port);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("Fork failed");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        // mync reports every session on stdout, which is reserved for results
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execl(mync, mync, option, command, "-b", endpoint, (char *)NULL);
+        _exit(127);
+    }
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    struct ttt_opponent opp;
+    ttt_opponent_parse("random:1", &opp);
+
+    long start = 0;
+    for (long g = -1; g < games; g++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+        // Game -1 waits for the listener and warms up; it is not timed
+        for (int tries = 0; connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1; tries++) {
+            if (g >= 0 || tries == 100) {
+                perror("Connect to mync failed");
+                kill(pid, SIGTERM);
+                exit(EXIT_FAILURE);
+            }
+            usleep(20000);
+        }
+        if (ttt_opponent_play_terse(fd, fd, &opp) == 'E') {
+            fprintf(stderr, "mync game %ld failed\n", g);
+            kill(pid, SIGTERM);
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+        if (g == -1) {
+            start = now_ns();
+        }
+    }
+    report(name, games / ((now_ns() - start) / 1e9), "games/s");
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+/**
+ * @brief Benchmark the ttt engine and end-to-end games.
+ *
+ * Usage: tttbench [-t ttt] [-m mync] [-s ttt.so] [-p port] [-g games]
+ * Microbenchmarks report ns/op; end-to-end runs report games/s through a
+ * pipe, through mync over loopback, and through mync hosting the ttt plugin
+ * in-process. Binaries are skipped when missing.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return int Exit status.
+ */
+int main(int argc, char *argv[]) {
+    const char *ttt = "./ttt";
+    const char *mync = "./mync";
+    const char *plugin = "./ttt.so";
+    int port = BENCH_PORT;
+    long games = 500;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:m:s:p:g:")) != -1) {
+        switch (opt) {
+            case 't':
+                ttt = optarg;
+                break;
+            case 'm':
+                mync = optarg;
+                break;
+            case 's':
+                plugin = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'g':
+                games = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t ttt] [-m mync] [-s ttt.so] [-p port] [-g games]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    bench("is_win", bench_is_win);
+    bench("pick", bench_pick);
+    bench("game_vs_random", bench_game);
+    bench("evaluate", bench_evaluate);
+    bench("nxn15_win_scalar", bench_nxn_scalar);
+#ifdef TTTN_SIMD
+    bench("nxn15_win_sse2", bench_nxn_sse2);
+    if (__builtin_cpu_supports("avx2")) {
+        bench("nxn15_win_avx2", bench_nxn_avx2);
+    }
+#endif
+
+    if (access(ttt, X_OK) == 0) {
+        bench_pipe(ttt, games);
+        if (access(mync, X_OK) == 0) {
+            bench_mync("mync_games", mync, "-e", ttt, port, games);
+        }
+    }
+    if (access(plugin, R_OK) == 0 && access(mync, X_OK) == 0) {
+        bench_mync("mync_plugin_games", mync, "-E", plugin, port + 1, games);
+    }
+    return 0;
+}
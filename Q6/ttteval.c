@@ -0,0 +1,253 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ttt_core.h"
+#include "ttt_index.h"
+#include "ttt_opponent.h"
+
+/**
+ * @brief A strategy to evaluate and its result.
+ */
+struct job {
+    char text[TTT_CELLS + 1];
+    struct ttt_strategy strategy;
+    struct ttt_outcome outcome;
+};
+
+/**
+ * @brief Work shared by the evaluation threads.
+ */
+struct pool {
+    struct job *jobs;
+    size_t njobs;
+    size_t next;                    // Next job to claim, advanced atomically
+    const struct ttt_index *index;  // Answer from the index instead of evaluating, or NULL
+    const struct ttt_opponent *opponent;  // Play games against it instead, or NULL
+    long games;                           // Games per strategy against the opponent
+};
+
+/**
+ * @brief Thread body: claim strategies one at a time and evaluate them.
+ *
+ * @param arg The shared pool.
+ * @return void* Always NULL.
+ */
+static void *worker(void *arg) {
+    struct pool *pool = arg;
+    size_t i;
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->njobs) {
+        struct job *job = &pool->jobs[i];
+        if (pool->opponent != NULL) {
+            // Each strategy gets its own copy, seeded by position, so results do not depend on threads
+            struct ttt_opponent opp = *pool->opponent;
+            opp.rng ^= (i + 1) * 0x9E3779B97F4A7C15ULL;
+            job->outcome = (struct ttt_outcome){0};
+            for (long g = 0; g < pool->games; g++) {
+                int result = ttt_play_game(&job->strategy, &opp);
+                if (result > 0) {
+                    job->outcome.wins++;
+                } else if (result < 0) {
+                    job->outcome.losses++;
+                } else {
+                    job->outcome.draws++;
+                }
+            }
+            continue;
+        }
+        if (pool->index == NULL) {
+            ttt_evaluate(&job->strategy, &job->outcome);
+            continue;
+        }
+
+        // The index has no lines, only the summary
+        const struct ttt_index_entry *entry = ttt_index_lookup(pool->index, &job->strategy);
+        job->outcome = (struct ttt_outcome){0};
+        job->outcome.wins = entry->wins;
+        job->outcome.losses = entry->losses;
+        job->outcome.draws = entry->draws;
+        job->outcome.shortest_loss = entry->shortest_loss;
+        job->outcome.nshortest = entry->nshortest;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Append a strategy to the job list, validating it like ttt does.
+ *
+ * @return int 0 on success, -1 for an invalid strategy.
+ */
+static int add_job(struct job **jobs, size_t *njobs, size_t *cap, const char *text) {
+    if (*njobs == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        *jobs = realloc(*jobs, *cap * sizeof(**jobs));
+        if (*jobs == NULL) {
+            perror("Allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct job *job = &(*jobs)[*njobs];
+    if (strlen(text) != TTT_CELLS || ttt_parse_strategy(text, &job->strategy) == -1) {
+        return -1;
+    }
+    memcpy(job->text, text, sizeof(job->text));
+    (*njobs)++;
+    return 0;
+}
+
+/**
+ * @brief Print one strategy's outcome and its shortest losing lines.
+ *
+ * Lines are human moves (1 based) joined by commas, as they would be typed.
+ */
+static void print_outcome(const struct job *job, int max_lines) {
+    const struct ttt_outcome *out = &job->outcome;
+    printf("%s wins=%u losses=%u draws=%u shortest_loss=%u",
+           job->text, out->wins, out->losses, out->draws, out->shortest_loss);
+
+    if (out->shortest_loss > 0) {
+        printf(" shortest_lines=%u", out->nshortest);
+        for (int l = 0; l < out->nlines && l < max_lines; l++) {
+            printf(l == 0 ? " " : ";");
+            for (int m = 0; m < out->shortest_loss; m++) {
+                printf(m == 0 ? "%d" : ",%d", out->lines[l][m] + 1);
+            }
+        }
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Evaluate ttt strategies against every legal line of human play.
+ *
+ * Usage: ttteval [-j threads] [-n lines] [-q] [-x index] [-o opponent [-g games]] [strategy ...]
+ * Strategies are read one per line from stdin when none are given. With -x
+ * the summaries come from a tttindex file instead of being evaluated. With
+ * -o each strategy plays games against an opponent engine instead.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return int Exit status.
+ */
+int main(int argc, char *argv[]) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_lines = TTT_MAX_LINES;
+    int quiet = 0;
+    const char *index_path = NULL;
+    struct ttt_index index;
+    const char *opponent_spec = NULL;
+    struct ttt_opponent opponent;
+    long games = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:n:qx:o:g:")) != -1) {
+        switch (opt) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'n':
+                max_lines = atoi(optarg);
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'x':
+                index_path = optarg;
+                break;
+            case 'o':
+                opponent_spec = optarg;
+                if (ttt_opponent_parse(optarg, &opponent) == -1) {
+                    fprintf(stderr, "Error: invalid opponent %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'g':
+                games = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-j threads] [-n lines] [-q] [-x index] [-o opponent [-g games]] [strategy ...]\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (games < 1) {
+        games = 1;
+    }
+
+    struct job *jobs = NULL;
+    size_t njobs = 0, cap = 0;
+    if (optind < argc) {
+        for (int i = optind; i < argc; i++) {
+            if (add_job(&jobs, &njobs, &cap, argv[i]) == -1) {
+                fprintf(stderr, "Error: invalid strategy %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+    } else {
+        char line[64];
+        while (fgets(line, sizeof(line), stdin) != NULL) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] != '\0' && add_job(&jobs, &njobs, &cap, line) == -1) {
+                fprintf(stderr, "Error: invalid strategy %s\n", line);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    struct pool pool = {jobs, njobs, 0, NULL, opponent_spec ? &opponent : NULL, games};
+    if (index_path != NULL) {
+        if (ttt_index_open(&index, index_path) == -1) {
+            fprintf(stderr, "Error: cannot map index %s\n", index_path);
+            exit(EXIT_FAILURE);
+        }
+        pool.index = &index;
+    }
+    if ((size_t)threads > njobs) {
+        threads = njobs > 0 ? njobs : 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t *tids = malloc(threads * sizeof(*tids));
+    for (long t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, worker, &pool) != 0) {
+            perror("Thread creation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    worker(&pool);
+    for (long t = 1; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+
+    if (!quiet) {
+        for (size_t i = 0; i < njobs; i++) {
+            if (opponent_spec != NULL) {
+                printf("%s vs=%s games=%ld wins=%u losses=%u draws=%u\n", jobs[i].text, opponent_spec, games,
+                       jobs[i].outcome.wins, jobs[i].outcome.losses, jobs[i].outcome.draws);
+            } else {
+                print_outcome(&jobs[i], max_lines);
+            }
+        }
+    }
+    fprintf(stderr, "Evaluated %zu strategies on %ld threads in %.1f us (%.2f us per strategy)\n",
+            njobs, threads, elapsed_us, njobs ? elapsed_us / njobs : 0.0);
+
+    if (pool.index != NULL) {
+        ttt_index_close(&index);
+    }
+    free(tids);
+    free(jobs);
+    return 0;
+}
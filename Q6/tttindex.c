@@ -0,0 +1,115 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ttt_index.h"
+
+#define CHUNK 4096  // Ranks claimed by a thread at a time
+
+/**
+ * @brief Work shared by the indexing threads.
+ */
+struct pool {
+    struct ttt_index_entry *entries;
+    uint32_t next;  // Next rank to claim, advanced atomically
+};
+
+/**
+ * @brief Thread body: evaluate chunks of ranks until all are done.
+ *
+ * @param arg The shared pool.
+ * @return void* Always NULL.
+ */
+static void *worker(void *arg) {
+    struct pool *pool = arg;
+    uint32_t first;
+
+    while ((first = __atomic_fetch_add(&pool->next, CHUNK, __ATOMIC_RELAXED)) < TTT_STRATEGIES) {
+        uint32_t last = first + CHUNK < TTT_STRATEGIES ? first + CHUNK : TTT_STRATEGIES;
+        for (uint32_t rank = first; rank < last; rank++) {
+            struct ttt_strategy strategy;
+            struct ttt_outcome outcome;
+            ttt_unrank(rank, &strategy);
+            ttt_evaluate(&strategy, &outcome);
+            ttt_index_pack(&outcome, &pool->entries[rank]);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Build the outcome index of every ttt strategy.
+ *
+ * Usage: tttindex [-j threads] [output]
+ * The index is written to a temporary file and renamed into place, so
+ * readers never map a partial index.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return int Exit status.
+ */
+int main(int argc, char *argv[]) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+        switch (opt) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-j threads] [output]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    const char *path = optind < argc ? argv[optind] : TTT_INDEX_FILE;
+
+    struct pool pool = {calloc(TTT_STRATEGIES, sizeof(struct ttt_index_entry)), 0};
+    pthread_t *tids = malloc(threads * sizeof(*tids));
+    if (pool.entries == NULL || tids == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, worker, &pool) != 0) {
+            perror("Thread creation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    worker(&pool);
+    for (long t = 1; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *file = fopen(tmp, "wb");
+    if (file == NULL) {
+        perror("Open index failed");
+        exit(EXIT_FAILURE);
+    }
+
+    struct ttt_index_header hdr = {TTT_INDEX_MAGIC, TTT_STRATEGIES, sizeof(struct ttt_index_entry)};
+    if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+        fwrite(pool.entries, sizeof(struct ttt_index_entry), TTT_STRATEGIES, file) != TTT_STRATEGIES ||
+        fclose(file) != 0 || rename(tmp, path) == -1) {
+        perror("Write index failed");
+        unlink(tmp);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "Indexed %d strategies on %ld threads in %.3f s\n", TTT_STRATEGIES, threads,
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    free(tids);
+    free(pool.entries);
+    return 0;
+}
@@ -0,0 +1,276 @@
+#ifndef TTTN_CORE_H
+#define TTTN_CORE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && !defined(TTTN_SCALAR)
+#include <immintrin.h>
+#define TTTN_SIMD 1
+#endif
+
+#define TTTN_MAX 16  // Largest board side: one row fits a 16-bit lane
+#define TTTN_MAX_CELLS (TTTN_MAX * TTTN_MAX)
+
+/**
+ * @brief An N x N board where k in a row wins, for N up to 16.
+ *
+ * Each player's cells are one 16-bit mask per row (bit c is column c).
+ * Rows are padded with zeros to twice the maximum so that rows r..r+15
+ * can be loaded as one vector for any r, which is how the SIMD win test
+ * lines up neighbouring rows.
+ */
+struct tttn_board {
+    uint16_t rows[2][TTTN_MAX * 2] __attribute__((aligned(32)));  // [0] is X (the program), [1] is O
+    uint8_t n;
+    uint8_t k;
+    uint16_t moves;  // Cells taken so far
+};
+
+/**
+ * @brief A strategy: all n * n cells in priority order.
+ */
+struct tttn_strategy {
+    uint16_t ncells;
+    uint8_t order[TTTN_MAX_CELLS];
+};
+
+/**
+ * @brief Start an empty board.
+ *
+ * @param board Board to initialize.
+ * @param n Side, 1 to TTTN_MAX.
+ * @param k Run length that wins, 1 to n.
+ */
+static inline void tttn_init(struct tttn_board *board, int n, int k) {
+    memset(board, 0, sizeof(*board));
+    board->n = n;
+    board->k = k;
+}
+
+/**
+ * @brief Whether a cell is taken by either player.
+ */
+static inline int tttn_taken(const struct tttn_board *board, int cell) {
+    int r = cell / board->n, c = cell % board->n;
+    return ((board->rows[0][r] | board->rows[1][r]) >> c) & 1;
+}
+
+/**
+ * @brief Owner of a cell: 0 for X, 1 for O, -1 if free.
+ */
+static inline int tttn_owner(const struct tttn_board *board, int cell) {
+    int r = cell / board->n, c = cell % board->n;
+    if (board->rows[0][r] >> c & 1) {
+        return 0;
+    }
+    return board->rows[1][r] >> c & 1 ? 1 : -1;
+}
+
+/**
+ * @brief Whether every cell is taken.
+ */
+static inline int tttn_full(const struct tttn_board *board) {
+    return board->moves == board->n * board->n;
+}
+
+/**
+ * @brief Win test that only walks the four lines through the last move.
+ *
+ * The position before the move had no win, so a new run of k must contain
+ * the last move. Each direction costs at most 2 * (k - 1) cell tests.
+ *
+ * @param board Board after the move.
+ * @param player 0 or 1.
+ * @param cell The move just made.
+ * @return int Non-zero for a win.
+ */
+static inline int tttn_is_win_scalar(const struct tttn_board *board, int player, int cell) {
+    static const int8_t dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    const uint16_t *rows = board->rows[player];
+    int n = board->n, r0 = cell / n, c0 = cell % n;
+
+    for (int d = 0; d < 4; d++) {
+        int run = 1;
+        for (int sign = -1; sign <= 1; sign += 2) {
+            int r = r0 + sign * dirs[d][0], c = c0 + sign * dirs[d][1];
+            while (run < board->k && r >= 0 && r < n && c >= 0 && c < n && (rows[r] >> c & 1)) {
+                run++;
+                r += sign * dirs[d][0];
+                c += sign * dirs[d][1];
+            }
+        }
+        if (run >= board->k) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#ifdef TTTN_SIMD
+/**
+ * @brief SSE2 win test over the whole board, 8 rows per vector.
+ *
+ * Runs in all four directions are found together with k - 1 shifted ANDs:
+ * rows shifted by i bits (horizontal), rows i further down (vertical) and
+ * rows i further down shifted by i bits either way (diagonals). The cost
+ * depends on k but not on the board size.
+ */
+static inline int tttn_is_win_sse2(const struct tttn_board *board, int player) {
+    const uint16_t *rows = board->rows[player];
+    __m128i lo = _mm_load_si128((const __m128i *)rows);
+    __m128i hi = _mm_load_si128((const __m128i *)(rows + 8));
+    __m128i h[2] = {lo, hi}, v[2] = {lo, hi}, d[2] = {lo, hi}, a[2] = {lo, hi};
+
+    for (int i = 1; i < board->k; i++) {
+        __m128i count = _mm_cvtsi32_si128(i);
+        __m128i below[2] = {_mm_loadu_si128((const __m128i *)(rows + i)),
+                            _mm_loadu_si128((const __m128i *)(rows + 8 + i))};
+        h[0] = _mm_and_si128(h[0], _mm_srl_epi16(lo, count));
+        h[1] = _mm_and_si128(h[1], _mm_srl_epi16(hi, count));
+        for (int j = 0; j < 2; j++) {
+            v[j] = _mm_and_si128(v[j], below[j]);
+            d[j] = _mm_and_si128(d[j], _mm_srl_epi16(below[j], count));
+            a[j] = _mm_and_si128(a[j], _mm_sll_epi16(below[j], count));
+        }
+    }
+
+    __m128i any = _mm_or_si128(_mm_or_si128(h[0], h[1]), _mm_or_si128(v[0], v[1]));
+    any = _mm_or_si128(any, _mm_or_si128(_mm_or_si128(d[0], d[1]), _mm_or_si128(a[0], a[1])));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF;
+}
+
+/**
+ * @brief AVX2 version of tttn_is_win_sse2(): all 16 rows in one vector.
+ */
+__attribute__((target("avx2"))) static inline int tttn_is_win_avx2(const struct tttn_board *board, int player) {
+    const uint16_t *rows = board->rows[player];
+    __m256i all = _mm256_load_si256((const __m256i *)rows);
+    __m256i h = all, v = all, d = all, a = all;
+
+    for (int i = 1; i < board->k; i++) {
+        __m128i count = _mm_cvtsi32_si128(i);
+        __m256i below = _mm256_loadu_si256((const __m256i *)(rows + i));
+        h = _mm256_and_si256(h, _mm256_srl_epi16(all, count));
+        v = _mm256_and_si256(v, below);
+        d = _mm256_and_si256(d, _mm256_srl_epi16(below, count));
+        a = _mm256_and_si256(a, _mm256_sll_epi16(below, count));
+    }
+
+    __m256i any = _mm256_or_si256(_mm256_or_si256(h, v), _mm256_or_si256(d, a));
+    return !_mm256_testz_si256(any, any);
+}
+#endif
+
+/**
+ * @brief Check whether the player who just took a cell has won.
+ *
+ * Uses AVX2 when the CPU has it, SSE2 otherwise, and the incremental
+ * scalar test on other architectures or when built with -DTTTN_SCALAR.
+ *
+ * @param board Board after the move.
+ * @param player 0 or 1.
+ * @param cell The move just made.
+ * @return int Non-zero for a win.
+ */
+static inline int tttn_is_win(const struct tttn_board *board, int player, int cell) {
+#ifdef TTTN_SIMD
+    static int have_avx2 = -1;
+    if (have_avx2 == -1) {
+        have_avx2 = __builtin_cpu_supports("avx2");
+    }
+    (void)cell;
+    return have_avx2 ? tttn_is_win_avx2(board, player) : tttn_is_win_sse2(board, player);
+#else
+    return tttn_is_win_scalar(board, player, cell);
+#endif
+}
+
+/**
+ * @brief Take a cell for a player.
+ *
+ * @param board Board.
+ * @param player 0 or 1.
+ * @param cell Free cell.
+ */
+static inline void tttn_play(struct tttn_board *board, int player, int cell) {
+    board->rows[player][cell / board->n] |= 1 << (cell % board->n);
+    board->moves++;
+}
+
+/**
+ * @brief Parse a strategy for an n x n board.
+ *
+ * The text is either a comma separated permutation of the cells 1..n*n, or
+ * "@<seed>" for a pseudo-random permutation, handy for load tests on large
+ * boards.
+ *
+ * @param text Strategy string.
+ * @param n Board side.
+ * @param strategy Receives the 0 based cell order.
+ * @return int 0 on success, -1 if the text is not a valid strategy.
+ */
+static inline int tttn_parse_strategy(const char *text, int n, struct tttn_strategy *strategy) {
+    uint8_t seen[TTTN_MAX_CELLS] = {0};
+    int ncells = n * n;
+
+    strategy->ncells = ncells;
+    if (text[0] == '@') {
+        char *end;
+        uint64_t seed = strtoull(text + 1, &end, 10);
+        if (end == text + 1 || *end != '\0') {
+            return -1;
+        }
+
+        // Fisher-Yates shuffle driven by xorshift64*
+        uint64_t state = seed * 2685821657736338717ULL + 1;
+        for (int i = 0; i < ncells; i++) {
+            strategy->order[i] = i;
+        }
+        for (int i = ncells - 1; i > 0; i--) {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            int j = (state * 2685821657736338717ULL) % (i + 1);
+            uint8_t tmp = strategy->order[i];
+            strategy->order[i] = strategy->order[j];
+            strategy->order[j] = tmp;
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < ncells; i++) {
+        char *end;
+        long cell = strtol(text, &end, 10);
+        if (end == text || cell < 1 || cell > ncells || seen[cell - 1] || *end != (i + 1 < ncells ? ',' : '\0')) {
+            return -1;
+        }
+        seen[cell - 1] = 1;
+        strategy->order[i] = cell - 1;
+        text = end + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Pick the program's move: the first free cell in strategy order.
+ *
+ * Same cursor contract as ttt_pick(), so a game costs at most n * n steps.
+ *
+ * @param strategy Strategy.
+ * @param cursor Position in the strategy, advanced past the chosen cell.
+ * @param board Board.
+ * @return int The chosen cell, or -1 when the board is full.
+ */
+static inline int tttn_pick(const struct tttn_strategy *strategy, int *cursor, const struct tttn_board *board) {
+    while (*cursor < strategy->ncells) {
+        int cell = strategy->order[(*cursor)++];
+        if (!tttn_taken(board, cell)) {
+            return cell;
+        }
+    }
+    return -1;
+}
+
+#endif
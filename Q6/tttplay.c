@@ -0,0 +1,108 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ttt_core.h"
+#include "ttt_opponent.h"
+
+/**
+ * @brief Connect to the server hosting ttt -t.
+ *
+ * @param addr Server address.
+ * @return int Connected socket.
+ */
+int connect_server(const struct sockaddr_in *addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == -1) {
+        perror("Connect failed");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+/**
+ * @brief Play games as the human side against ttt -t hosted by mync.
+ *
+ * Usage: tttplay [-o opponent] [-g games] <ip> <port>
+ * Each game is a new connection, for example to
+ * mync -e "ttt -t 123456789" -b TCPMUXS<port>. Results are counted from the
+ * program's point of view, like ttteval.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return int Exit status: 1 if any game broke off.
+ */
+int main(int argc, char *argv[]) {
+    const char *spec = "perfect";
+    struct ttt_opponent opp;
+    long games = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:g:")) != -1) {
+        switch (opt) {
+            case 'o':
+                spec = optarg;
+                break;
+            case 'g':
+                games = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-o opponent] [-g games] <ip> <port>\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 2 || ttt_opponent_parse(spec, &opp) == -1) {
+        fprintf(stderr, "Usage: %s [-o opponent] [-g games] <ip> <port>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *ip = argv[optind];
+    if (strncmp(ip, "localhost", 9) == 0) {
+        ip = "127.0.0.1";  // Convert "localhost" to "127.0.0.1"
+    }
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(argv[optind + 1]));
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) <= 0) {
+        perror("Invalid address");
+        exit(EXIT_FAILURE);
+    }
+
+    long wins = 0, losses = 0, draws = 0, errors = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long g = 0; g < games; g++) {
+        int fd = connect_server(&addr);
+        switch (ttt_opponent_play_terse(fd, fd, &opp)) {
+            case 'W':
+                wins++;
+                break;
+            case 'L':
+                losses++;
+                break;
+            case 'D':
+                draws++;
+                break;
+            default:
+                errors++;
+        }
+        close(fd);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("games=%ld wins=%ld losses=%ld draws=%ld errors=%ld elapsed=%.3f games_per_sec=%.0f\n", games, wins,
+           losses, draws, errors, elapsed, elapsed > 0 ? games / elapsed : 0.0);
+    return errors ? 1 : 0;
+}
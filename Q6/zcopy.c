@@ -0,0 +1,123 @@
+#include "zcopy.h"
+
+#include <errno.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+int zc_init(struct zc_sender *z, int fd, size_t threshold) {
+    int one = 1;
+    memset(z, 0, sizeof(*z));
+    z->fd = fd;
+    z->threshold = threshold;
+    if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == -1) {
+        return -1;
+    }
+    for (int i = 0; i < ZC_SLOTS; i++) {
+        z->slots[i].data = mmap(NULL, ZC_SLOT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (z->slots[i].data == MAP_FAILED) {
+            int saved = errno;
+            z->slots[i].data = NULL;
+            zc_close(z);
+            errno = saved;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+char *zc_buffer(struct zc_sender *z) {
+    struct zc_slot *slot = &z->slots[z->cur];
+    return slot->inflight ? NULL : slot->data;
+}
+
+ssize_t zc_write(struct zc_sender *z, const char *buf, size_t len) {
+    if (!z->disabled && len >= z->threshold) {
+        ssize_t n = send(z->fd, buf, len, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (n >= 0) {
+            z->slots[z->cur].last_id = z->next_id++;
+            z->referenced = 1;
+            z->sends++;
+            z->bytes += n;
+            return n;
+        }
+        if (errno != ENOBUFS) {
+            return -1;
+        }
+        // Out of option memory for notifications: copy this chunk
+    }
+    return send(z->fd, buf, len, MSG_NOSIGNAL);
+}
+
+void zc_release(struct zc_sender *z) {
+    if (z->referenced) {
+        z->slots[z->cur].inflight = 1;  // Freed by zc_reap() once its last send completes
+        z->referenced = 0;
+    }
+    z->cur = (z->cur + 1) % ZC_SLOTS;
+}
+
+int zc_reap(struct zc_sender *z) {
+    char control[128];
+
+    for (;;) {
+        struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+        if (recvmsg(z->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            break;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0) {
+                continue;
+            }
+            // ee_info..ee_data is the range of completed ids, reported in order
+            if ((int32_t)(err->ee_data + 1 - z->done) > 0) {
+                z->done = err->ee_data + 1;
+            }
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                z->copied++;
+                z->disabled = 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < ZC_SLOTS; i++) {
+        struct zc_slot *slot = &z->slots[i];
+        if (slot->inflight && (int32_t)(z->done - slot->last_id) > 0) {
+            slot->inflight = 0;
+        }
+    }
+
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(z->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int zc_busy(struct zc_sender *z) {
+    for (int i = 0; i < ZC_SLOTS; i++) {
+        if (z->slots[i].inflight) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void zc_close(struct zc_sender *z) {
+    for (int i = 0; i < ZC_SLOTS; i++) {
+        if (z->slots[i].data != NULL) {
+            munmap(z->slots[i].data, ZC_SLOT_SIZE);
+            z->slots[i].data = NULL;
+        }
+    }
+}
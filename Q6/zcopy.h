@@ -0,0 +1,95 @@
+#ifndef ZCOPY_H
+#define ZCOPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ZC_SLOTS 4                    // Buffers per sender, so reading goes on while sends are in flight
+#define ZC_SLOT_SIZE (256 * 1024)
+#define ZC_THRESHOLD 16384            // Default smallest write sent with MSG_ZEROCOPY
+
+/**
+ * @brief A relay buffer handed to the kernel by reference.
+ */
+struct zc_slot {
+    char *data;
+    uint32_t last_id;  // Last zerocopy send that referenced the slot
+    int inflight;      // Not to be rewritten until last_id completes
+};
+
+/**
+ * @brief MSG_ZEROCOPY sends to one socket out of a set of recycled buffers.
+ *
+ * Writes of at least threshold bytes are sent with MSG_ZEROCOPY, so the
+ * kernel transmits straight from the slot instead of copying it. Each such
+ * send gets the next id of the socket; the kernel reports finished ids on
+ * the socket's error queue, which raises EPOLLERR, and only then may the
+ * slot be filled again. When the kernel reports that it had to copy anyway
+ * (loopback, or a device without scatter-gather), the sender falls back to
+ * plain sends, which are cheaper than a copy plus a notification.
+ */
+struct zc_sender {
+    int fd;
+    size_t threshold;
+    struct zc_slot slots[ZC_SLOTS];
+    int cur;              // Slot being filled and written
+    int referenced;       // cur was sent with MSG_ZEROCOPY since it was filled
+    uint32_t next_id;     // Id of the next zerocopy send
+    uint32_t done;        // Every id before it completed
+    int disabled;         // Plain sends only
+    unsigned long sends;  // Zerocopy sends
+    unsigned long bytes;  // Bytes sent with zerocopy
+    unsigned long copied; // Completions the kernel reported as copied
+};
+
+/**
+ * @brief Enable SO_ZEROCOPY on a socket and map the sender's slots.
+ *
+ * @param z Sender to initialize.
+ * @param fd Connected TCP socket.
+ * @param threshold Smallest write sent with MSG_ZEROCOPY.
+ * @return int 0 on success, -1 with errno set if the socket or kernel refuses.
+ */
+int zc_init(struct zc_sender *z, int fd, size_t threshold);
+
+/**
+ * @brief The slot to read the next chunk into.
+ *
+ * @return char* ZC_SLOT_SIZE bytes, or NULL while every slot is in flight.
+ */
+char *zc_buffer(struct zc_sender *z);
+
+/**
+ * @brief Send part of the current slot.
+ *
+ * @return ssize_t Bytes accepted, or -1 with errno set as by send().
+ */
+ssize_t zc_write(struct zc_sender *z, const char *buf, size_t len);
+
+/**
+ * @brief The current slot was written completely; move on to the next one.
+ */
+void zc_release(struct zc_sender *z);
+
+/**
+ * @brief Consume completion notifications from the socket's error queue.
+ *
+ * @return int 0 on success, -1 with errno set if the socket has a real error.
+ */
+int zc_reap(struct zc_sender *z);
+
+/**
+ * @brief Check whether the kernel still references any slot.
+ */
+int zc_busy(struct zc_sender *z);
+
+/**
+ * @brief Unmap the slots.
+ *
+ * Pages the kernel still references stay pinned until it releases them, so
+ * in-flight data is never overwritten by a later mapping.
+ */
+void zc_close(struct zc_sender *z);
+
+#endif